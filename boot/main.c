@@ -52,8 +52,10 @@ bootmain(void)
 	eph = ph + ELFHDR->e_phnum;
 	for (; ph < eph; ph++)
 		// p_pa is the load address of this segment (as well
-		// as the physical address)
-		readseg(ph->p_pa, ph->p_memsz, ph->p_offset);
+		// as the physical address).  Only the part that is in
+		// the file is read: kernel_main() clears the .bss, and
+		// reading it would run past the end of the disk image.
+		readseg(ph->p_pa, ph->p_filesz, ph->p_offset);
 
 	// call the entry point from the ELF header
 	// note: does not return!
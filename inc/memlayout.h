@@ -0,0 +1,28 @@
+#ifndef JOS_INC_MEMLAYOUT_H
+#define JOS_INC_MEMLAYOUT_H
+
+/*
+ * This file contains definitions for the physical memory layout the
+ * kernel relies on.  It is included from assembly as well as C.
+ *
+ * The kernel runs without paging, so virtual and physical addresses
+ * are the same.
+ */
+
+// Physical address the AP bootstrap code (kernel/mpentry.S) is copied to
+#define MPENTRY_PADDR	0x7000
+
+// The BIOS data area, in real-mode segment 0x40
+#define BDA_PADDR	(0x40 << 4)
+
+#ifndef __ASSEMBLER__
+
+#include <inc/types.h>
+
+// A pointer to physical address pa: with paging off, physical
+// addresses are virtual ones, so this is only a cast.
+#define PHYSPTR(pa)	((void *) (physaddr_t) (pa))
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* !JOS_INC_MEMLAYOUT_H */
@@ -17,7 +17,8 @@
 #define GD_KD     0x10     // kernel data
 #define GD_UT     0x18     // user text
 #define GD_UD     0x20     // user data
-#define GD_TSS0   0x28     // Task segment selector for CPU 0
+#define GD_TSS0   0x28     // Task segment selector (each CPU has its own GDT)
+#define GD_PERCPU 0x30     // per-CPU data, loaded into %gs
 
 /*
  *
@@ -100,6 +101,8 @@
 #define CR0_CD		0x40000000	// Cache Disable
 #define CR0_PG		0x80000000	// Paging
 
+#define CR4_OSXMMEXCPT	0x00000400	// Unmasked SSE exceptions raise #XM
+#define CR4_OSFXSR	0x00000200	// OS saves SSE state; enables SSE
 #define CR4_PCE		0x00000100	// Performance counter enable
 #define CR4_MCE		0x00000040	// Machine Check Enable
 #define CR4_PSE		0x00000010	// Page Size Extensions
@@ -0,0 +1,55 @@
+#ifndef JOS_INC_RING_H
+#define JOS_INC_RING_H
+
+#include <inc/types.h>
+#include <inc/x86.h>
+
+/*
+ * Single-producer/single-consumer lock-free byte ring.
+ *
+ * Exactly one context may put into a ring and exactly one may get
+ * from it; each side then needs no lock and no atomic instruction.
+ * "One context" can be several interrupt handlers on the same CPU,
+ * since interrupt gates keep them from nesting.
+ *
+ * r_head and r_tail count bytes since ring_init and are only masked
+ * when indexing, so head - tail is always the fill level.  Each index
+ * lives on its own cache line next to the side that writes it, so the
+ * producer and consumer don't keep stealing one line from each other.
+ * When the ring is full, new data is dropped (the unread data is kept)
+ * and counted in r_overflow.
+ */
+struct ring {
+	uint8_t *r_buf;			// Storage, r_mask + 1 bytes
+	uint32_t r_mask;		// Size - 1; the size is a power of 2
+	uint8_t r_pad0[CACHELINE - 8];
+
+	// Producer side
+	volatile uint32_t r_head;	// Total bytes put
+	uint32_t r_overflow;		// Bytes dropped because the ring was full
+	uint8_t r_pad1[CACHELINE - 8];
+
+	// Consumer side
+	volatile uint32_t r_tail;	// Total bytes taken
+	uint8_t r_pad2[CACHELINE - 4];
+} __attribute__((aligned(CACHELINE)));
+
+void ring_init(struct ring *r, void *buf, uint32_t size);
+int ring_put(struct ring *r, uint8_t c);
+uint32_t ring_write(struct ring *r, const void *buf, uint32_t len);
+int ring_get(struct ring *r);
+uint32_t ring_read(struct ring *r, void *buf, uint32_t len);
+
+static __inline uint32_t
+ring_count(struct ring *r)
+{
+	return r->r_head - r->r_tail;
+}
+
+static __inline uint32_t
+ring_space(struct ring *r)
+{
+	return r->r_mask + 1 - (r->r_head - r->r_tail);
+}
+
+#endif /* !JOS_INC_RING_H */
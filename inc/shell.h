@@ -2,9 +2,15 @@
 #define SHELL_H
 
 void shell();
+int runcmd(char *buf);
+int shell_nunknown(void);
 int mon_help(int argc, char **argv);
 int mon_kerninfo(int argc, char **argv);
 int print_tick(int argc, char **argv);
 int chgcolor(int argc, char **argv);
+int mon_cpus(int argc, char **argv);
+int mon_lockstat(int argc, char **argv);
+int mon_time(int argc, char **argv);
+int mon_repeat(int argc, char **argv);
 
 #endif
@@ -0,0 +1,139 @@
+#ifndef JOS_INC_SPINLOCK_H
+#define JOS_INC_SPINLOCK_H
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/x86.h>
+
+/*
+ * Three kinds of busy-waiting locks:
+ *
+ *   struct spinlock	test-and-test-and-set; cheapest when uncontended,
+ *			but unfair.  The _irqsave variants also disable
+ *			interrupts, for state shared with handlers.
+ *   struct ticketlock	FIFO order: each waiter takes a ticket and spins
+ *			until it is served.
+ *   struct mcslock	FIFO queue lock; each waiter spins on its own
+ *			struct mcs_node, so waiting causes no cache-line
+ *			traffic on the lock itself.
+ *
+ * When the kernel is built with LOCKSTAT defined (make LOCKSTAT=1),
+ * every lock also counts acquisitions, contended acquisitions, wait-loop
+ * spins and its longest hold time.  A lock registers itself on first
+ * acquisition; the 'lockstat' shell command lists them.
+ */
+
+struct lockstat {
+	const char *ls_name;
+	uint32_t ls_acquired;		// Times acquired
+	uint32_t ls_contended;		// ... of which had to wait
+	uint32_t ls_spins;		// Wait-loop iterations, in total
+	uint64_t ls_hold_start;		// TSC when last acquired
+	uint64_t ls_hold_max;		// Longest hold, in TSC cycles
+	struct lockstat *ls_next;	// Registry of all locks
+	bool ls_registered;
+};
+
+#ifdef LOCKSTAT
+#define LOCKSTAT_INIT(name)	, { (name) }
+#else
+#define LOCKSTAT_INIT(name)
+#endif
+
+struct spinlock {
+	volatile uint32_t locked;
+#ifdef LOCKSTAT
+	struct lockstat stat;
+#endif
+};
+#define SPINLOCK_INIT(name)	{ 0 LOCKSTAT_INIT(name) }
+
+struct ticketlock {
+	volatile uint32_t next;		// Next ticket to hand out
+	volatile uint32_t owner;	// Ticket being served
+#ifdef LOCKSTAT
+	struct lockstat stat;
+#endif
+};
+#define TICKETLOCK_INIT(name)	{ 0, 0 LOCKSTAT_INIT(name) }
+
+struct mcs_node {
+	struct mcs_node * volatile next;
+	volatile uint32_t locked;
+};
+
+struct mcslock {
+	struct mcs_node * volatile tail;
+#ifdef LOCKSTAT
+	struct lockstat stat;
+#endif
+};
+#define MCSLOCK_INIT(name)	{ NULL LOCKSTAT_INIT(name) }
+
+// When the kernel is built with IRQSOFF defined (make IRQSOFF=1),
+// every switch of the interrupt flag is reported to kernel/irqsoff.c,
+// which keeps the longest interrupts-off section of each CPU.  eip is
+// where the switch happened, or 0 for the caller of the hook.
+#ifdef IRQSOFF
+void irqsoff_begin(uintptr_t eip);
+void irqsoff_end(uintptr_t eip);
+#else
+#define irqsoff_begin(eip)	do { } while (0)
+#define irqsoff_end(eip)	do { } while (0)
+#endif
+
+// Disable interrupts, returning the previous %eflags for irq_restore.
+static __inline uint32_t
+irq_save(void)
+{
+	uint32_t eflags = read_eflags();
+	__asm __volatile("cli" ::: "memory");
+	if (eflags & FL_IF)
+		irqsoff_begin(0);
+	return eflags;
+}
+
+static __inline void
+irq_restore(uint32_t eflags)
+{
+	if (eflags & FL_IF) {
+		irqsoff_end(0);
+		__asm __volatile("sti" ::: "memory");
+	}
+}
+
+void spin_initlock(struct spinlock *lk, const char *name);
+void spin_lock(struct spinlock *lk);
+int spin_trylock(struct spinlock *lk);
+void spin_unlock(struct spinlock *lk);
+
+// Inline so that the interrupts-off tracer sees the real caller
+static __inline uint32_t
+spin_lock_irqsave(struct spinlock *lk)
+{
+	uint32_t eflags = irq_save();
+
+	spin_lock(lk);
+	return eflags;
+}
+
+static __inline void
+spin_unlock_irqrestore(struct spinlock *lk, uint32_t eflags)
+{
+	spin_unlock(lk);
+	irq_restore(eflags);
+}
+
+void ticket_initlock(struct ticketlock *lk, const char *name);
+void ticket_lock(struct ticketlock *lk);
+void ticket_unlock(struct ticketlock *lk);
+
+void mcs_initlock(struct mcslock *lk, const char *name);
+void mcs_lock(struct mcslock *lk, struct mcs_node *me);
+void mcs_unlock(struct mcslock *lk, struct mcs_node *me);
+
+// Head of the registry of locks that have been acquired at least once
+extern struct lockstat *lockstat_list;
+void lockstat_reset(void);
+
+#endif /* !JOS_INC_SPINLOCK_H */
@@ -9,12 +9,27 @@
 
 //lib/kbd.c
 int	getc(void);
+void	serial_init(void);
+void	serial_write(const char *buf, int len);
+void	serial_drain(void);
 
 //lib/screen.c
 void	putch(unsigned char c);
 void	puts(unsigned char *text);
+void	console_write(const char *buf, int len);
+void	screen_write(const char *buf, int len);
+void	console_flush(void);
+void	console_scrollback(int lines);
+void	console_live(void);
+int	console_set_null(int null);
 
 // lib/printfmt.c
+// Output sink for vprintfmt_sink(): write() gets whole runs of bytes
+struct printsink {
+	void (*write)(const char *buf, int len, void *putdat);
+	void *putdat;
+};
+void	vprintfmt_sink(const struct printsink *sink, const char *fmt, va_list);
 void	printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
 void	vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list);
 int	snprintf(char *str, int size, const char *fmt, ...);
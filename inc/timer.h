@@ -1,5 +1,14 @@
 #ifndef TIMER_H
 #define TIMER_H
+
+#include <inc/types.h>
+
+/* Timer ticks per second */
+#define TIME_HZ 100
+
 void timer_init();
+void timer_set_rate(int mult);
 unsigned long get_tick();
+unsigned long get_tsc_khz();
+uint64_t cycles_to_ns(uint64_t cycles);
 #endif
@@ -27,6 +27,8 @@
 // These are arbitrarily chosen, but with care not to overlap
 // processor defined exceptions or interrupt vectors.
 #define T_SYSCALL   48		// system call
+#define T_WAKEUP    49		// IPI that wakes a halted idle CPU
+#define T_BENCH     50		// does nothing; 'bench' times the round trip
 #define T_DEFAULT   500		// catchall
 
 #define IRQ_OFFSET	32	// IRQ 0 corresponds to int IRQ_OFFSET
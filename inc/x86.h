@@ -6,6 +6,13 @@
 
 #include <inc/types.h>
 
+// Size of a cache line, for padding shared data apart
+#define CACHELINE	64
+
+// CPUID feature bits
+#define CPUID_1_EDX_SSE2	(1 << 26)	// Leaf 1: SSE2 instructions
+#define CPUID_7_EBX_ERMS	(1 << 9)	// Leaf 7: enhanced rep movsb/stosb
+
 static __inline void breakpoint(void) __attribute__((always_inline));
 static __inline uint8_t inb(int port) __attribute__((always_inline));
 static __inline void insb(int port, void *addr, int cnt) __attribute__((always_inline));
@@ -37,6 +44,7 @@ static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline void pause(void) __attribute__((always_inline));
 
 static __inline void
 breakpoint(void)
@@ -283,6 +291,14 @@ read_tsc(void)
 	return tsc;
 }
 
+static __inline void
+pause(void)
+{
+	// Spin-wait hint: saves power and avoids a memory-order
+	// mis-speculation penalty when the loop exits.
+	__asm __volatile("pause" ::: "memory");
+}
+
 static inline uint32_t
 xchg(volatile uint32_t *addr, uint32_t newval)
 {
@@ -296,4 +312,39 @@ xchg(volatile uint32_t *addr, uint32_t newval)
 	return result;
 }
 
+static inline uint32_t
+cmpxchg(volatile uint32_t *addr, uint32_t oldval, uint32_t newval)
+{
+	uint32_t result;
+
+	// Store newval only if *addr still holds oldval;
+	// either way return what *addr held.
+	asm volatile("lock; cmpxchgl %2, %1" :
+			"=a" (result), "+m" (*addr) :
+			"r" (newval), "0" (oldval) :
+			"memory", "cc");
+	return result;
+}
+
+static inline uint32_t
+xadd(volatile uint32_t *addr, uint32_t inc)
+{
+	uint32_t result;
+
+	// Atomically add inc to *addr and return the old value.
+	asm volatile("lock; xaddl %0, %1" :
+			"=r" (result), "+m" (*addr) :
+			"0" (inc) :
+			"memory", "cc");
+	return result;
+}
+
+static __inline void
+mfence(void)
+{
+	// A locked add is a full barrier on every x86, even
+	// on CPUs that predate the SSE2 mfence instruction.
+	__asm __volatile("lock; addl $0,0(%%esp)" ::: "memory", "cc");
+}
+
 #endif /* !JOS_INC_X86_H */
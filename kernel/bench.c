@@ -0,0 +1,329 @@
+// Microbenchmarks for library code and core kernel primitives.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/stdarg.h>
+#include <inc/string.h>
+#include <inc/spinlock.h>
+#include <inc/timer.h>
+#include <inc/trap.h>
+#include <kernel/cpu.h>
+#include <kernel/log.h>
+#include <kernel/bench.h>
+#include <kernel/benchrun.h>
+
+/***** Number formatting *****/
+
+// The recursive printnum that lib/printfmt.c used to have, kept as
+// the baseline: one call level and one 64-bit / and % per digit.
+static void
+printnum_ref(void (*putch)(int, void*), void *putdat,
+	     unsigned long long num, unsigned base, int width, int padc)
+{
+	if (num >= base) {
+		printnum_ref(putch, putdat, num / base, base, width - 1, padc);
+	} else {
+		while (--width > 0)
+			putch(padc, putdat);
+	}
+	putch("0123456789abcdef"[num % base], putdat);
+}
+
+struct fmtbuf {
+	char *p;
+	char buf[32];
+};
+
+static void
+fmtbuf_putch(int ch, struct fmtbuf *b)
+{
+	*b->p++ = ch;
+}
+
+static uint32_t fmt_seed;
+
+static uint32_t
+fmt_rand(void)
+{
+	fmt_seed ^= fmt_seed << 13;
+	fmt_seed ^= fmt_seed >> 17;
+	fmt_seed ^= fmt_seed << 5;
+	return fmt_seed;
+}
+
+// Format n numbers of the given kind both ways, writing into the same
+// buffer, and return the cycles each took in *ref and *cur.  Values
+// are random with a random bit length, so every digit count shows up.
+static void
+fmtbench_run(int n, unsigned base, int wide, uint64_t *ref, uint64_t *cur)
+{
+	struct fmtbuf b;
+	unsigned long long v;
+	const char *fmt;
+	uint64_t start;
+	int i;
+
+	fmt = base == 16 ? (wide ? "%llx" : "%x") : (wide ? "%llu" : "%u");
+
+	fmt_seed = 2463534242U;
+	start = read_tsc();
+	for (i = 0; i < n; i++) {
+		v = wide ? ((unsigned long long) fmt_rand() << 32) | fmt_rand()
+			 : fmt_rand();
+		v >>= fmt_rand() % (wide ? 64 : 32);
+		b.p = b.buf;
+		printnum_ref((void *) fmtbuf_putch, &b, v, base, -1, ' ');
+	}
+	*ref = read_tsc() - start;
+
+	fmt_seed = 2463534242U;
+	start = read_tsc();
+	for (i = 0; i < n; i++) {
+		v = wide ? ((unsigned long long) fmt_rand() << 32) | fmt_rand()
+			 : fmt_rand();
+		v >>= fmt_rand() % (wide ? 64 : 32);
+		if (wide)
+			snprintf(b.buf, sizeof(b.buf), fmt, v);
+		else
+			snprintf(b.buf, sizeof(b.buf), fmt, (uint32_t) v);
+	}
+	*cur = read_tsc() - start;
+}
+
+// Compare the recursive printnum with the current vprintfmt number
+// path.  The current path is timed through snprintf, so its figures
+// also include parsing the format string.
+int
+mon_fmtbench(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		unsigned base;
+		int wide;
+	} kinds[] = {
+		{ "%u", 10, 0 },
+		{ "%x", 16, 0 },
+		{ "%llu", 10, 1 },
+		{ "%llx", 16, 1 },
+	};
+	int n = argc > 1 ? strtol(argv[1], NULL, 0) : 10000;
+	uint64_t ref, cur;
+	int i;
+
+	if (n <= 0) {
+		cprintf("Usage: fmtbench [count]\n");
+		return 0;
+	}
+	cprintf("FORMAT  RECURSIVE    CURRENT  (cycles per number, %d numbers)\n", n);
+	for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+		fmtbench_run(n, kinds[i].base, kinds[i].wide, &ref, &cur);
+		cprintf("%-6s %10u %10u\n", kinds[i].name,
+			(uint32_t) (ref / n), (uint32_t) (cur / n));
+	}
+	return 0;
+}
+
+/***** Core primitives *****/
+
+// Each benchmark does its operation batch times per timed run, with
+// interrupts off so ticks don't land in the figures.  After WARMUP
+// untimed runs come BENCH_RUNS timed ones, and we report the fastest
+// and the median cycles per operation.
+#define WARMUP		2
+#define BENCH_RUNS	15
+
+// Largest copy: bigger buffers would only add .bss to every boot
+#define BENCH_BUFSIZE	(64 << 10)
+
+static uint8_t bench_src[BENCH_BUFSIZE] __attribute__((aligned(CACHELINE)));
+static uint8_t bench_dst[BENCH_BUFSIZE] __attribute__((aligned(CACHELINE)));
+
+struct Bench {
+	const char *name;
+	void (*run)(uint32_t arg, int n);	// Do the operation n times
+	uint32_t arg;
+	int batch;				// Operations per timed run
+	bool screen;				// Draws on the screen
+};
+
+static void
+bench_memcpy(uint32_t size, int n)
+{
+	while (n-- > 0)
+		memcpy(bench_dst, bench_src, size);
+}
+
+static void
+bench_memset(uint32_t size, int n)
+{
+	while (n-- > 0)
+		memset(bench_dst, n, size);
+}
+
+static void
+null_write(const char *buf, int len, void *putdat)
+{
+}
+
+static void
+screen_sink_write(const char *buf, int len, void *putdat)
+{
+	screen_write(buf, len);
+}
+
+static void
+bench_printf(const struct printsink *sink, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintfmt_sink(sink, fmt, ap);
+	va_end(ap);
+}
+
+// A typical kernel message: formatting only, or drawn into the
+// screen shadow.  The '\r' keeps the screen benchmark on one line.
+static void
+bench_cprintf(uint32_t to_screen, int n)
+{
+	static const struct printsink null_sink = { null_write, NULL };
+	static const struct printsink screen_sink = { screen_sink_write, NULL };
+	// Not cpunum(), which would time a LAPIC read with the formatting
+	int cpu = thiscpu->cpu_id;
+
+	while (n-- > 0)
+		bench_printf(to_screen ? &screen_sink : &null_sink,
+			     "cpu %d: %s %u ticks, 0x%08x\r",
+			     cpu, "bench", n, (uint32_t) bench_src);
+}
+
+// The screen half of putch(); writing to COM1 would time the UART.
+// A newline at the bottom row scrolls.
+static void
+bench_putch(uint32_t c, int n)
+{
+	char ch = c;
+
+	while (n-- > 0)
+		screen_write(&ch, 1);
+}
+
+// One character and a flush, which copies the row to video memory
+// and moves the hardware cursor
+static void
+bench_flush(uint32_t c, int n)
+{
+	char ch = c;
+
+	while (n-- > 0) {
+		screen_write(&ch, 1);
+		console_flush();
+	}
+}
+
+// int $T_BENCH through _alltraps to trap_dispatch and back
+static void
+bench_int(uint32_t arg, int n)
+{
+	while (n-- > 0)
+		__asm __volatile("int %0" : : "i" (T_BENCH) : "memory");
+}
+
+static void
+bench_inb(uint32_t port, int n)
+{
+	while (n-- > 0)
+		inb(port);
+}
+
+static void
+bench_outb(uint32_t port, int n)
+{
+	while (n-- > 0)
+		outb(port, 0);
+}
+
+static const struct Bench benches[] = {
+	{ "memcpy 64", bench_memcpy, 64, 1000 },
+	{ "memcpy 1K", bench_memcpy, 1024, 256 },
+	{ "memcpy 4K", bench_memcpy, 4096, 64 },
+	{ "memcpy 64K", bench_memcpy, BENCH_BUFSIZE, 4 },
+	{ "memset 64", bench_memset, 64, 1000 },
+	{ "memset 1K", bench_memset, 1024, 256 },
+	{ "memset 4K", bench_memset, 4096, 64 },
+	{ "memset 64K", bench_memset, BENCH_BUFSIZE, 4 },
+	{ "cprintf null", bench_cprintf, 0, 100 },
+	{ "cprintf screen", bench_cprintf, 1, 100, 1 },
+	{ "putch", bench_putch, '.', 1000, 1 },
+	{ "putch+flush", bench_flush, '.', 100, 1 },
+	{ "putch newline", bench_putch, '\n', 100, 1 },
+	{ "int round trip", bench_int, 0, 1000 },
+	{ "inb 0x64", bench_inb, 0x64, 100 },
+	{ "outb 0x80", bench_outb, 0x80, 100 },
+};
+
+// Cycles per operation of the fastest and the median run
+static void
+bench_time(const struct Bench *b, uint32_t *min, uint32_t *median)
+{
+	uint32_t runs[BENCH_RUNS], t, eflags;
+	uint64_t start;
+	int i, j;
+
+	for (i = 0; i < WARMUP + BENCH_RUNS; i++) {
+		eflags = irq_save();
+		start = read_tsc();
+		b->run(b->arg, b->batch);
+		t = (read_tsc() - start) / b->batch;
+		irq_restore(eflags);
+		if (i < WARMUP)
+			continue;
+
+		// Insertion sort as we go
+		for (j = i - WARMUP; j > 0 && runs[j - 1] > t; j--)
+			runs[j] = runs[j - 1];
+		runs[j] = t;
+	}
+	*min = runs[0];
+	*median = runs[BENCH_RUNS / 2];
+}
+
+// Run the benchmarks whose names start with argv[1], or all of them.
+// The screen benchmarks draw over the console, so the table is
+// printed once they are done.
+int
+mon_bench(int argc, char **argv)
+{
+	static uint32_t mins[sizeof(benches) / sizeof(benches[0])];
+	static uint32_t medians[sizeof(benches) / sizeof(benches[0])];
+	const char *prefix = argc > 1 ? argv[1] : "";
+	bool screen = 0;
+	int i, n = 0;
+
+	log_drain();
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		if (strncmp(benches[i].name, prefix, strlen(prefix)) != 0)
+			continue;
+		bench_time(&benches[i], &mins[i], &medians[i]);
+		screen |= benches[i].screen;
+		n++;
+	}
+	if (n == 0) {
+		cprintf("Usage: bench [name prefix]\n");
+		return 0;
+	}
+	if (screen)
+		putch('\n');
+
+	cprintf("BENCHMARK             MIN     MEDIAN  (cycles per op, %d runs)\n",
+		BENCH_RUNS);
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+		if (strncmp(benches[i].name, prefix, strlen(prefix)) == 0) {
+			cprintf("%-16s %8u %10u\n", benches[i].name,
+				mins[i], medians[i]);
+			benchrun_result(medians[i], "cycles", "bench %s",
+					benches[i].name);
+		}
+	return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef JOS_KERN_BENCH_H
+#define JOS_KERN_BENCH_H
+
+int mon_fmtbench(int argc, char **argv);
+int mon_bench(int argc, char **argv);
+
+#endif	// !JOS_KERN_BENCH_H
@@ -0,0 +1,146 @@
+// Unattended benchmark runs under QEMU.  See kernel/benchrun.h.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/shell.h>
+#include <inc/timer.h>
+#include <kernel/cpu.h>
+#include <kernel/log.h>
+#include <kernel/prof.h>
+#include <kernel/benchrun.h>
+
+// QEMU's fw_cfg I/O interface: write a selector, then read its bytes
+#define FWCFG_PORT_SEL		0x510
+#define FWCFG_PORT_DATA		0x511
+#define FWCFG_SIGNATURE		0x0000	// "QEMU"
+#define FWCFG_FILE_DIR		0x0019	// Count, then struct FwCfgFile[]
+
+// Directory entry; numbers are big-endian
+struct FwCfgFile {
+	uint32_t f_size;
+	uint16_t f_select;
+	uint16_t f_reserved;
+	char f_name[56];
+};
+
+static char script[BENCHRUN_SCRIPTSIZE + 1];
+static bool running;
+
+static void
+fwcfg_read(uint16_t select, void *buf, int len)
+{
+	outw(FWCFG_PORT_SEL, select);
+	insb(FWCFG_PORT_DATA, buf, len);
+}
+
+static uint32_t
+be32(uint32_t x)
+{
+	return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) |
+		(x << 24);
+}
+
+// Find the fw_cfg file called name.  Returns its size and sets
+// *select, or returns -1 if there is no such file (or no QEMU).
+static int
+fwcfg_find(const char *name, uint16_t *select)
+{
+	struct FwCfgFile f;
+	uint32_t n, i;
+	char sig[4];
+
+	fwcfg_read(FWCFG_SIGNATURE, sig, sizeof(sig));
+	if (memcmp(sig, "QEMU", 4) != 0)
+		return -1;
+	fwcfg_read(FWCFG_FILE_DIR, &n, sizeof(n));
+	// The entries follow the count in the same item
+	for (i = 0; i < be32(n); i++) {
+		insb(FWCFG_PORT_DATA, &f, sizeof(f));
+		if (strncmp(f.f_name, name, sizeof(f.f_name)) == 0) {
+			*select = (f.f_select >> 8) | (f.f_select << 8);
+			return be32(f.f_size);
+		}
+	}
+	return -1;
+}
+
+// Print a result line for test/benchcmp.sh.  Only under benchrun()
+// and with the profiler off, so commands can report results
+// unconditionally.
+void
+benchrun_result(uint64_t value, const char *unit, const char *fmt, ...)
+{
+	char name[128];
+	va_list ap;
+
+	if (!running || prof_running())
+		return;
+	va_start(ap, fmt);
+	vsnprintf(name, sizeof(name), fmt, ap);
+	va_end(ap);
+	cprintf("@@ result %llu %s %s\n", value, unit, name);
+}
+
+// Run the script QEMU passed in, if any, and power off.  Returns
+// only if there is no script or no isa-debug-exit device.
+void
+benchrun(void)
+{
+	uint64_t start, cycles;
+	uint16_t select;
+	char *line, *next, *p;
+	int size, r, unknown, bad, failed = 0;
+
+	if ((size = fwcfg_find(BENCHRUN_FWCFG, &select)) < 0)
+		return;
+	if (size > BENCHRUN_SCRIPTSIZE) {
+		cprintf("benchrun: script truncated to %d bytes\n",
+			BENCHRUN_SCRIPTSIZE);
+		size = BENCHRUN_SCRIPTSIZE;
+	}
+	fwcfg_read(select, script, size);
+	script[size] = 0;
+
+	// The TSC counts from reset, so this is the time to boot
+	running = 1;
+	cprintf("@@ benchrun %d cpus, %lu kHz\n", ncpu, get_tsc_khz());
+	benchrun_result(cycles_to_ns(read_tsc()), "ns", "boot");
+
+	for (line = script; line; line = next) {
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = 0;
+		if ((p = strchr(line, '#')) != NULL)
+			*p = 0;
+		for (p = line; *p == ' ' || *p == '\t' || *p == '\r'; p++)
+			/* skip */;
+		if (*p == 0)
+			continue;
+		if ((p = strchr(line, '\r')) != NULL)
+			*p = 0;
+
+		cprintf("@@ begin %s\n", line);
+		unknown = shell_nunknown();
+		start = read_tsc();
+		r = runcmd(line);
+		cycles = read_tsc() - start;
+		// A misspelled command, even inside time or repeat,
+		// fails the run but lets the rest of the script run
+		bad = r < 0 || shell_nunknown() != unknown;
+		cprintf("@@ end %d %llu cycles %llu ns\n", bad, cycles,
+			cycles_to_ns(cycles));
+		failed += bad;
+		if (r < 0)
+			break;
+	}
+	cprintf("@@ done %d\n", failed ? 1 : 0);
+	running = 0;
+
+	// Let the last lines out before QEMU goes away
+	log_drain();
+	serial_drain();
+	outb(BENCHRUN_EXIT_PORT, failed ? 1 : 0);
+	cprintf("benchrun: no isa-debug-exit device at 0x%x\n",
+		BENCHRUN_EXIT_PORT);
+}
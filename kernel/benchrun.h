@@ -0,0 +1,41 @@
+#ifndef JOS_KERN_BENCHRUN_H
+#define JOS_KERN_BENCHRUN_H
+
+#include <inc/types.h>
+
+/*
+ * Unattended benchmark runs under QEMU ('make qemu-bench').
+ *
+ * QEMU hands the kernel a script through the fw_cfg file
+ * BENCHRUN_FWCFG: shell commands, one per line, '#' starts a comment.
+ * benchrun() runs them before the shell starts and prints
+ *
+ *	@@ begin <command>
+ *	...the command's output...
+ *	@@ end <status> <cycles> cycles <ns> ns
+ *	@@ result <value> <unit> <name>
+ *
+ * over the console, then powers QEMU off through the isa-debug-exit
+ * device at BENCHRUN_EXIT_PORT.  A command's status is 1 if it was
+ * not found or asked the shell to exit, and the run's status is 0
+ * only if every command's was.
+ *
+ * Result lines come from benchrun_result().  Lower values are better,
+ * and test/benchcmp.sh compares them with a baseline.  None are
+ * reported while the profiler samples, since its interrupts would be
+ * in them: a script measures first and profiles in a second pass.
+ */
+
+#define BENCHRUN_FWCFG		"opt/nctuos/bench"
+
+// -device isa-debug-exit,iobase=0xf4,iosize=0x04; QEMU exits with
+// (value << 1) | 1
+#define BENCHRUN_EXIT_PORT	0xf4
+
+// Longest script, in bytes
+#define BENCHRUN_SCRIPTSIZE	4096
+
+void benchrun(void);
+void benchrun_result(uint64_t value, const char *unit, const char *fmt, ...);
+
+#endif	// !JOS_KERN_BENCHRUN_H
@@ -0,0 +1,66 @@
+/* Modify from MIT 6.828 course resource
+*  Reference: http://pdos.csail.mit.edu/6.828/2012/
+*/
+#ifndef JOS_KERN_CPU_H
+#define JOS_KERN_CPU_H
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+
+// Maximum number of CPUs
+#define NCPU  8
+
+// Values of status in struct CpuInfo
+enum {
+	CPU_UNUSED = 0,
+	CPU_STARTED,
+	CPU_HALTED,
+};
+
+// Number of descriptors in each CPU's private GDT
+#define NGDTENTRIES	((GD_PERCPU >> 3) + 1)
+
+// Per-CPU state.  Each CPU reaches its own CpuInfo through %gs,
+// whose segment base is the address of the structure itself.
+struct CpuInfo {
+	struct CpuInfo *cpu_self;	// Must be first: %gs:0 points here
+	uint8_t cpu_id;			// Index of this CPU in cpus[]
+	uint8_t cpu_apicid;		// Local APIC ID
+	volatile unsigned cpu_status;	// The status of the CPU
+	uintptr_t cpu_kstacktop;	// Top of this CPU's kernel stack
+	struct Segdesc cpu_gdt[NGDTENTRIES];	// Private GDT
+	struct Pseudodesc cpu_gdt_pd;
+	struct Taskstate cpu_ts;	// Used by x86 to find stack for interrupt
+	volatile uint32_t cpu_nintr;	// Interrupts taken by this CPU
+};
+
+// Initialized in mpconfig.c
+extern struct CpuInfo cpus[NCPU];
+extern int ncpu;			// Total number of CPUs in the system
+extern struct CpuInfo *bootcpu;		// The boot-strap processor (BSP)
+extern physaddr_t lapicaddr;		// Physical MMIO address of the local APIC
+
+// Per-CPU kernel stacks
+extern unsigned char percpu_kstacks[NCPU][KSTKSIZE];
+
+// The running CPU's CpuInfo.  Only valid after trap_init_percpu()
+// has loaded this CPU's %gs.
+static __inline struct CpuInfo *
+thiscpu_get(void)
+{
+	struct CpuInfo *c;
+	__asm("movl %%gs:0, %0" : "=r" (c));
+	return c;
+}
+#define thiscpu	(thiscpu_get())
+
+int cpunum(void);
+
+void mp_init(void);
+void lapic_init(void);
+void lapic_startap(uint8_t apicid, uint32_t addr);
+void lapic_eoi(void);
+void lapic_ipi(uint8_t apicid, int vector);
+
+#endif
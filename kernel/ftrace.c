@@ -0,0 +1,238 @@
+// Function tracing.  See kernel/ftrace.h.
+//
+// This file is left out of -finstrument-functions (see the Makefile),
+// as are the inline functions in inc/ and kernel/cpu.h, since the
+// hooks would otherwise call themselves.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <kernel/cpu.h>
+#include <kernel/kdebug.h>
+#include <kernel/ftrace.h>
+
+#ifdef FTRACE
+
+struct FtraceBuf {
+	volatile uint32_t fb_next;	// Records written since cleared
+	uint8_t fb_pad[CACHELINE - 4];
+	struct FtraceRecord fb_recs[FTRACE_SIZE];
+} __attribute__((aligned(CACHELINE)));
+
+static struct FtraceBuf ftracebufs[NCPU];
+static volatile bool ftrace_enabled;
+
+// Only the owning CPU writes its ring, so claiming a slot needs no
+// lock prefix, as in trace_record().  Until a CPU's trap_init_percpu()
+// has loaded %gs there is no thiscpu, and the call is not recorded;
+// that also covers the BSP running before .bss is cleared.
+static __inline __attribute__((always_inline)) void
+ftrace_record(void *fn, void *site, uint64_t exit)
+{
+	struct FtraceBuf *fb;
+	struct FtraceRecord *fr;
+	uint32_t idx = 1;
+	uint16_t gs;
+
+	if (!ftrace_enabled)
+		return;
+	__asm __volatile("movw %%gs, %0" : "=r" (gs));
+	if (gs != GD_PERCPU)
+		return;
+	fb = &ftracebufs[thiscpu->cpu_id];
+	__asm __volatile("xaddl %0, %1" : "+r" (idx), "+m" (fb->fb_next));
+	fr = &fb->fb_recs[idx & (FTRACE_SIZE - 1)];
+	fr->fr_tsc = read_tsc() | exit;
+	fr->fr_fn = (uintptr_t) fn;
+	fr->fr_site = (uintptr_t) site;
+}
+
+void
+__cyg_profile_func_enter(void *fn, void *site)
+{
+	ftrace_record(fn, site, 0);
+}
+
+void
+__cyg_profile_func_exit(void *fn, void *site)
+{
+	ftrace_record(fn, site, FTRACE_EXIT);
+}
+
+// Records the boot until ftrace_enable(0) before the shell starts
+void
+ftrace_init(void)
+{
+	ftrace_enabled = 1;
+}
+
+void
+ftrace_enable(bool on)
+{
+	ftrace_enabled = on;
+}
+
+static void
+ftrace_clear(void)
+{
+	int i;
+
+	for (i = 0; i < ncpu; i++)
+		ftracebufs[i].fb_next = 0;
+}
+
+struct FtraceFunc {
+	uintptr_t ff_fn;		// 0 if the slot is free
+	uint32_t ff_calls;
+	uint64_t ff_incl;		// Cycles from entry to exit
+	uint64_t ff_excl;		// ... less the functions it called
+};
+
+static struct FtraceFunc ftrace_funcs[FTRACE_FUNCS];
+static uint32_t ftrace_unmatched;	// Exits whose entry wasn't found
+static uint32_t ftrace_lost;		// Functions that didn't fit
+
+static void
+ftrace_account(uintptr_t fn, uint64_t incl, uint64_t excl)
+{
+	struct FtraceFunc *ff;
+	uint32_t i, h = fn * 0x9e3779b1;
+
+	for (i = 0; i < FTRACE_FUNCS; i++) {
+		ff = &ftrace_funcs[(h + i) & (FTRACE_FUNCS - 1)];
+		if (ff->ff_fn == 0)
+			ff->ff_fn = fn;
+		if (ff->ff_fn == fn) {
+			ff->ff_calls++;
+			ff->ff_incl += incl;
+			ff->ff_excl += excl;
+			return;
+		}
+	}
+	ftrace_lost++;
+}
+
+// Replay one CPU's retained records, matching each exit with its
+// entry on a shadow call stack.  Calls still running at the end of
+// the ring, and exits from before its start, are left out.  Interrupt
+// handlers count towards the function they interrupted.
+static void
+ftrace_replay(struct FtraceBuf *fb)
+{
+	struct {
+		uintptr_t fn;
+		uint64_t start;
+		uint64_t children;
+	} stack[FTRACE_DEPTH];
+	struct FtraceRecord *fr;
+	uint32_t pos, end = fb->fb_next;
+	uint64_t tsc, incl;
+	int depth = 0, d;
+
+	for (pos = end > FTRACE_SIZE ? end - FTRACE_SIZE : 0; pos != end; pos++) {
+		fr = &fb->fb_recs[pos & (FTRACE_SIZE - 1)];
+		tsc = fr->fr_tsc & ~FTRACE_EXIT;
+		if (!(fr->fr_tsc & FTRACE_EXIT)) {
+			if (depth == FTRACE_DEPTH) {
+				// Too deep: forget the outermost call
+				memmove(stack, stack + 1, sizeof(stack[0]) * (depth - 1));
+				depth--;
+			}
+			stack[depth].fn = fr->fr_fn;
+			stack[depth].start = tsc;
+			stack[depth].children = 0;
+			depth++;
+			continue;
+		}
+
+		for (d = depth - 1; d >= 0 && stack[d].fn != fr->fr_fn; d--)
+			;
+		if (d < 0) {
+			ftrace_unmatched++;
+			continue;
+		}
+		depth = d;
+		incl = tsc - stack[d].start;
+		ftrace_account(fr->fr_fn, incl, incl - stack[d].children);
+		if (d > 0)
+			stack[d - 1].children += incl;
+	}
+}
+
+// Total the retained records per function and show the n with the
+// most exclusive cycles
+static void
+ftrace_report(int n)
+{
+	struct FtraceFunc *ff, t;
+	struct Eipdebuginfo info;
+	bool was_enabled = ftrace_enabled;
+	int i, j;
+
+	// Stop tracing so the rings hold still while we read them
+	ftrace_enabled = 0;
+
+	memset(ftrace_funcs, 0, sizeof(ftrace_funcs));
+	ftrace_unmatched = ftrace_lost = 0;
+	for (i = 0; i < ncpu; i++)
+		ftrace_replay(&ftracebufs[i]);
+
+	cprintf("    CALLS      INCLUSIVE      EXCLUSIVE  FUNCTION\n");
+	for (i = 0; i < n && i < FTRACE_FUNCS; i++) {
+		for (j = i + 1; j < FTRACE_FUNCS; j++)
+			if (ftrace_funcs[j].ff_excl > ftrace_funcs[i].ff_excl) {
+				t = ftrace_funcs[i];
+				ftrace_funcs[i] = ftrace_funcs[j];
+				ftrace_funcs[j] = t;
+			}
+		ff = &ftrace_funcs[i];
+		if (ff->ff_fn == 0)
+			break;
+		debuginfo_eip(ff->ff_fn, &info);
+		cprintf("%9u %14llu %14llu  %.*s\n", ff->ff_calls, ff->ff_incl,
+			ff->ff_excl, info.eip_fn_namelen, info.eip_fn_name);
+	}
+	cprintf("(cycles; %u exits without an entry, %u functions dropped)\n",
+		ftrace_unmatched, ftrace_lost);
+
+	ftrace_enabled = was_enabled;
+}
+
+int
+mon_ftrace(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "on") == 0)
+		ftrace_enabled = 1;
+	else if (argc > 1 && strcmp(argv[1], "off") == 0)
+		ftrace_enabled = 0;
+	else if (argc > 1 && strcmp(argv[1], "clear") == 0)
+		ftrace_clear();
+	else if (argc > 1 && strcmp(argv[1], "report") == 0)
+		ftrace_report(argc > 2 ? strtol(argv[2], NULL, 0) : 20);
+	else
+		cprintf("Usage: ftrace on|off|clear|report [count] (tracing is %s)\n",
+			ftrace_enabled ? "on" : "off");
+	return 0;
+}
+
+#else	// !FTRACE
+
+void
+ftrace_init(void)
+{
+}
+
+void
+ftrace_enable(bool on)
+{
+}
+
+int
+mon_ftrace(int argc, char **argv)
+{
+	cprintf("Function tracing is not compiled in; rebuild with 'make FTRACE=1'\n");
+	return 0;
+}
+
+#endif	// !FTRACE
@@ -0,0 +1,32 @@
+#ifndef JOS_KERN_FTRACE_H
+#define JOS_KERN_FTRACE_H
+
+#include <inc/types.h>
+
+/*
+ * Function tracing.  A 'make FTRACE=1' kernel is compiled with
+ * -finstrument-functions, so every function calls the hooks in
+ * kernel/ftrace.c on entry and exit.  While tracing is on, each call
+ * records the function, its call site and the TSC in the running
+ * CPU's ring; while it is off a hook costs a call, a load and a
+ * return.  In other builds these functions do nothing.
+ */
+
+#define FTRACE_SIZE	8192		// Records per CPU (a power of 2)
+#define FTRACE_DEPTH	64		// Nesting followed by 'ftrace report'
+#define FTRACE_FUNCS	1024		// Functions 'ftrace report' can total
+
+// Set in fr_tsc for a function exit
+#define FTRACE_EXIT	(1ULL << 63)
+
+struct FtraceRecord {
+	uint64_t fr_tsc;		// With FTRACE_EXIT on exit
+	uintptr_t fr_fn;
+	uintptr_t fr_site;
+};
+
+void ftrace_init(void);
+void ftrace_enable(bool on);
+int mon_ftrace(int argc, char **argv);
+
+#endif	// !JOS_KERN_FTRACE_H
@@ -0,0 +1,172 @@
+// Keypress-to-glyph latency.  See kernel/inputlat.h.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/timer.h>
+#include <kernel/inputlat.h>
+
+enum {
+	STAGE_DECODE,		// irq -> decode
+	STAGE_READ,		// decode -> read
+	STAGE_ECHO,		// read -> echo
+	STAGE_SHOWN,		// echo -> shown
+	STAGE_TOTAL,		// irq -> shown
+	NSTAGES
+};
+
+static const char * const stage_names[NSTAGES] = {
+	"irq -> decode",
+	"decode -> read",
+	"read -> echo",
+	"echo -> shown",
+	"irq -> shown",
+};
+
+struct LatHist {
+	uint32_t lh_count;
+	uint64_t lh_sum, lh_min, lh_max;
+	uint32_t lh_buckets[INPUTLAT_BUCKETS];
+};
+
+static struct LatHist hists[NSTAGES];
+
+// Stamps of the characters in the console buffer, in the same order:
+// the interrupt handlers add them and getc() takes them.
+struct KeyStamp {
+	uint64_t ks_irq;
+	uint64_t ks_decode;
+};
+
+static struct KeyStamp queue[INPUTLAT_QUEUE];
+static volatile uint32_t queue_head, queue_tail;
+
+// The character getc() returned last, on its way to the screen
+static struct {
+	enum { KEY_NONE, KEY_READ, KEY_ECHOED } state;
+	uint64_t irq, read, echo;
+} key;
+
+static void
+record(int stage, uint64_t t)
+{
+	struct LatHist *lh = &hists[stage];
+	int b = 0;
+
+	while (b < INPUTLAT_BUCKETS - 1 && (t >> (b + 1)))
+		b++;
+	lh->lh_buckets[b]++;
+	if (lh->lh_count == 0 || t < lh->lh_min)
+		lh->lh_min = t;
+	if (t > lh->lh_max)
+		lh->lh_max = t;
+	lh->lh_sum += t;
+	lh->lh_count++;
+}
+
+// Called by the console interrupt handlers for each character they
+// put in the console buffer, with the TSC when the handler started
+void
+inputlat_decoded(uint64_t irq_tsc)
+{
+	struct KeyStamp *ks;
+
+	if (queue_head - queue_tail >= INPUTLAT_QUEUE)
+		return;
+	ks = &queue[queue_head % INPUTLAT_QUEUE];
+	ks->ks_irq = irq_tsc;
+	ks->ks_decode = read_tsc();
+	__asm __volatile("" ::: "memory");
+	queue_head++;
+}
+
+// Called by getc() for each character it takes from the buffer
+void
+inputlat_read(void)
+{
+	struct KeyStamp *ks;
+
+	if (queue_head == queue_tail)
+		return;
+	ks = &queue[queue_tail % INPUTLAT_QUEUE];
+	key.irq = ks->ks_irq;
+	key.read = read_tsc();
+	record(STAGE_DECODE, ks->ks_decode - ks->ks_irq);
+	record(STAGE_READ, key.read - ks->ks_decode);
+	__asm __volatile("" ::: "memory");
+	queue_tail++;
+	key.state = KEY_READ;
+}
+
+// Called with the screen locked once putch(), readline's echo, has
+// drawn the key into the shadow
+void
+inputlat_echo(void)
+{
+	if (key.state != KEY_READ)
+		return;
+	key.echo = read_tsc();
+	record(STAGE_ECHO, key.echo - key.read);
+	key.state = KEY_ECHOED;
+}
+
+// getc() handled the key itself and nothing will echo it
+void
+inputlat_drop(void)
+{
+	key.state = KEY_NONE;
+}
+
+// Called with the screen locked after copying rows to video memory
+void
+inputlat_shown(void)
+{
+	uint64_t now;
+
+	if (key.state != KEY_ECHOED)
+		return;
+	now = read_tsc();
+	record(STAGE_SHOWN, now - key.echo);
+	record(STAGE_TOTAL, now - key.irq);
+	key.state = KEY_NONE;
+}
+
+// Print cycles as microseconds with three decimals
+static void
+print_us(const char *label, uint64_t cycles)
+{
+	uint64_t ns = cycles_to_ns(cycles);
+
+	cprintf("  %s %u.%03u us", label, (uint32_t) (ns / 1000),
+		(uint32_t) (ns % 1000));
+}
+
+int
+mon_inputlat(int argc, char **argv)
+{
+	struct LatHist *lh;
+	int s, b;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		memset(hists, 0, sizeof(hists));
+		return 0;
+	}
+
+	for (s = 0; s < NSTAGES; s++) {
+		lh = &hists[s];
+		cprintf("%-15s %6u keys", stage_names[s], lh->lh_count);
+		if (lh->lh_count) {
+			print_us("min", lh->lh_min);
+			print_us("avg", lh->lh_sum / lh->lh_count);
+			print_us("max", lh->lh_max);
+		}
+		cprintf("\n");
+		for (b = 0; b < INPUTLAT_BUCKETS; b++)
+			if (lh->lh_buckets[b])
+				cprintf("    < %10u ns %8u\n",
+					(uint32_t) cycles_to_ns(2ULL << b),
+					lh->lh_buckets[b]);
+	}
+	return 0;
+}
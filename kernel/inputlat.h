@@ -0,0 +1,35 @@
+#ifndef JOS_KERN_INPUTLAT_H
+#define JOS_KERN_INPUTLAT_H
+
+#include <inc/types.h>
+
+/*
+ * Keypress-to-glyph latency.  Each input character is stamped on its
+ * way from the interrupt to the screen:
+ *
+ *	irq	the keyboard or serial handler starts
+ *	decode	the driver has turned it into a character
+ *	read	getc() takes it from the console buffer
+ *	echo	readline echoes it with putch()
+ *	shown	the next flush copies it to video memory
+ *
+ * and the time between each pair of stages goes into a histogram.
+ * A key that is never echoed (PgUp, or backspace at the start of the
+ * line) is not counted past "read": the next key read replaces it.
+ */
+
+// Histogram buckets: bucket b counts times of 2^b to 2^(b+1)-1 cycles
+#define INPUTLAT_BUCKETS	40
+
+// Stamps kept for characters waiting in the console buffer
+#define INPUTLAT_QUEUE		512
+
+void inputlat_decoded(uint64_t irq_tsc);
+void inputlat_read(void);
+void inputlat_echo(void);
+void inputlat_drop(void);
+void inputlat_shown(void);
+
+int mon_inputlat(int argc, char **argv);
+
+#endif	// !JOS_KERN_INPUTLAT_H
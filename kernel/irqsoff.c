@@ -0,0 +1,126 @@
+// Interrupts-off latency tracer.
+//
+// In a 'make IRQSOFF=1' kernel, irq_save(), irq_restore(), the idle
+// halt and trap entry and exit report each switch of the interrupt
+// flag here (see inc/spinlock.h).  Every CPU times its sections with
+// interrupts off and keeps the longest, with where it began and
+// ended; 'irqsoff' shows them.  This is the worst delay an interrupt
+// such as a keypress can see before its handler runs.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/spinlock.h>
+#include <inc/timer.h>
+#include <kernel/cpu.h>
+#include <kernel/kdebug.h>
+#include <kernel/irqsoff.h>
+
+#ifdef IRQSOFF
+
+struct IrqsOff {
+	bool io_off;			// In a section
+	uintptr_t io_start_eip;
+	uint64_t io_start;		// TSC at the start of the section
+	uint32_t io_sections;		// Sections ended
+
+	// The longest section
+	uint64_t io_max;
+	uintptr_t io_max_start, io_max_end;
+} __attribute__((aligned(CACHELINE)));
+
+static struct IrqsOff irqsoff[NCPU];
+
+// Until a CPU's trap_init_percpu() has loaded %gs there is no
+// thiscpu, and its sections are not timed.
+static struct IrqsOff *
+irqsoff_this(void)
+{
+	uint16_t gs;
+
+	__asm __volatile("movw %%gs, %0" : "=r" (gs));
+	return gs == GD_PERCPU ? &irqsoff[thiscpu->cpu_id] : NULL;
+}
+
+void
+irqsoff_begin(uintptr_t eip)
+{
+	struct IrqsOff *io = irqsoff_this();
+
+	if (!io)
+		return;
+	io->io_off = 1;
+	io->io_start_eip = eip ? eip : (uintptr_t) __builtin_return_address(0);
+	io->io_start = read_tsc();
+}
+
+void
+irqsoff_end(uintptr_t eip)
+{
+	struct IrqsOff *io = irqsoff_this();
+	uint64_t t;
+
+	if (!io || !io->io_off)
+		return;
+	t = read_tsc() - io->io_start;
+	io->io_off = 0;
+	io->io_sections++;
+	if (t > io->io_max) {
+		io->io_max = t;
+		io->io_max_start = io->io_start_eip;
+		io->io_max_end = eip ? eip : (uintptr_t) __builtin_return_address(0);
+	}
+}
+
+// Print eip as function+offset
+static int
+format_eip(char *buf, int size, uintptr_t eip)
+{
+	struct Eipdebuginfo info;
+
+	if (debuginfo_eip(eip, &info) < 0)
+		return snprintf(buf, size, "0x%08x", eip);
+	return snprintf(buf, size, "%.*s+0x%x", info.eip_fn_namelen,
+			info.eip_fn_name, eip - info.eip_fn_addr);
+}
+
+int
+mon_irqsoff(int argc, char **argv)
+{
+	char from[64], to[64];
+	struct IrqsOff io;
+	int i;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		for (i = 0; i < ncpu; i++) {
+			irqsoff[i].io_sections = 0;
+			irqsoff[i].io_max = 0;
+		}
+		return 0;
+	}
+
+	cprintf("CPU   SECTIONS      MAX CYCLES     MAX US  FROM -> TO\n");
+	for (i = 0; i < ncpu; i++) {
+		// The CPU may be updating it; a copy is at least consistent
+		// with itself unless a new maximum lands while we copy
+		io = irqsoff[i];
+		format_eip(from, sizeof(from), io.io_max_start);
+		format_eip(to, sizeof(to), io.io_max_end);
+		cprintf("%3d %10u %15llu %10u  %s -> %s\n", i, io.io_sections,
+			io.io_max, (uint32_t) (cycles_to_ns(io.io_max) / 1000),
+			io.io_max ? from : "-", io.io_max ? to : "-");
+	}
+	return 0;
+}
+
+#else	// !IRQSOFF
+
+int
+mon_irqsoff(int argc, char **argv)
+{
+	cprintf("The interrupts-off tracer is not compiled in; rebuild with 'make IRQSOFF=1'\n");
+	return 0;
+}
+
+#endif	// !IRQSOFF
@@ -0,0 +1,6 @@
+#ifndef JOS_KERN_IRQSOFF_H
+#define JOS_KERN_IRQSOFF_H
+
+int mon_irqsoff(int argc, char **argv);
+
+#endif	// !JOS_KERN_IRQSOFF_H
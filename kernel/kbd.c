@@ -6,6 +6,12 @@
 #include <inc/trap.h>
 #include <kernel/picirq.h>
 #include <inc/stdio.h>
+#include <inc/ring.h>
+#include <inc/spinlock.h>
+#include <kernel/log.h>
+#include <kernel/inputlat.h>
+
+static void cons_intr(int (*proc)(void), uint64_t irq_tsc);
 
 /***** Keyboard input code *****/
 
@@ -158,6 +164,205 @@ kbd_proc_data(void)
 	return c;
 }
 
+/***** Serial I/O code *****/
+
+#define COM1		0x3F8
+
+#define COM_RX		0	// In:	Receive buffer (DLAB=0)
+#define COM_TX		0	// Out: Transmit buffer (DLAB=0)
+#define COM_DLL		0	// Out: Divisor Latch Low (DLAB=1)
+#define COM_DLM		1	// Out: Divisor Latch High (DLAB=1)
+#define COM_IER		1	// Out: Interrupt Enable Register
+#define   COM_IER_RDI	0x01	//   Enable receiver data interrupt
+#define   COM_IER_TXRDY	0x02	//   Enable transmit holding register empty
+#define COM_IIR		2	// In:	Interrupt ID Register
+#define   COM_IIR_NOPEND 0x01	//   No interrupt pending
+#define   COM_IIR_ID	0x0E	//   Interrupt identification:
+#define   COM_IIR_MLSC	0x00	//     modem status
+#define   COM_IIR_TXRDY	0x02	//     transmit holding register empty
+#define   COM_IIR_RXRDY	0x04	//     received data available
+#define   COM_IIR_RLS	0x06	//     receiver line status
+#define   COM_IIR_RXTOUT 0x0C	//     FIFO character timeout
+#define COM_FCR		2	// Out: FIFO Control Register
+#define   COM_FCR_ENABLE 0x01	//   Enable the FIFOs
+#define   COM_FCR_RCVRST 0x02	//   Clear the receive FIFO
+#define   COM_FCR_XMTRST 0x04	//   Clear the transmit FIFO
+#define   COM_FCR_TRIG8	0x80	//   Receive interrupt at 8 bytes
+#define COM_LCR		3	// Out: Line Control Register
+#define	  COM_LCR_DLAB	0x80	//   Divisor latch access bit
+#define	  COM_LCR_WLEN8	0x03	//   Wordlength: 8 bits
+#define COM_MCR		4	// Out: Modem Control Register
+#define	  COM_MCR_RTS	0x02	// RTS complement
+#define	  COM_MCR_DTR	0x01	// DTR complement
+#define	  COM_MCR_OUT2	0x08	// Out2 complement (gates the IRQ line)
+#define COM_LSR		5	// In:	Line Status Register
+#define   COM_LSR_DATA	0x01	//   Data available
+#define   COM_LSR_TXRDY	0x20	//   Transmit buffer avail
+#define   COM_LSR_TSRE	0x40	//   Transmitter off
+#define COM_MSR		6	// In:	Modem Status Register
+
+#define COM_FIFOSIZE	16	// Bytes the 16550 transmit FIFO holds
+
+// Output is queued in serial_tx and moved to the UART by the
+// transmit interrupt, COM_FIFOSIZE bytes at a time, so printing
+// never waits for the line.  Any CPU may print, so serial_lock
+// serializes the producers, and the interrupt handler takes it too
+// to keep tx_busy consistent with the IER.
+#define SERIAL_TXSIZE	16384
+
+static bool serial_exists;
+static uint8_t serial_txbuf[SERIAL_TXSIZE];
+static struct ring serial_tx;
+static bool tx_busy;		// COM_IER_TXRDY is enabled
+static struct spinlock serial_lock = SPINLOCK_INIT("serial");
+
+static int
+serial_proc_data(void)
+{
+	if (!(inb(COM1+COM_LSR) & COM_LSR_DATA))
+		return -1;
+	return inb(COM1+COM_RX);
+}
+
+// Refill the transmit FIFO from serial_tx; it must be empty.
+// Turns the transmit interrupt off once there is nothing left.
+// Called with serial_lock held.
+static void
+serial_start(void)
+{
+	int i, c;
+
+	for (i = 0; i < COM_FIFOSIZE; i++) {
+		if ((c = ring_get(&serial_tx)) == -1)
+			break;
+		outb(COM1+COM_TX, c);
+	}
+	if (ring_count(&serial_tx) == 0 && tx_busy) {
+		tx_busy = 0;
+		outb(COM1+COM_IER, COM_IER_RDI);
+	}
+}
+
+static void
+serial_put(uint8_t c)
+{
+	// Rather than lose output when the queue is full (e.g.
+	// with interrupts off), wait for the line to drain some of it.
+	while (ring_space(&serial_tx) == 0) {
+		while (!(inb(COM1+COM_LSR) & COM_LSR_TXRDY))
+			pause();
+		serial_start();
+	}
+	ring_put(&serial_tx, c);
+}
+
+// Queue len bytes for output, turning \n into \r\n.
+void
+serial_write(const char *buf, int len)
+{
+	uint32_t eflags;
+	int i;
+
+	if (!serial_exists)
+		return;
+
+	eflags = spin_lock_irqsave(&serial_lock);
+	for (i = 0; i < len; i++) {
+		if (buf[i] == '\n')
+			serial_put('\r');
+		serial_put(buf[i]);
+	}
+	// Enabling the transmit interrupt while the holding register
+	// is empty raises it right away, which starts the transfer.
+	if (!tx_busy && ring_count(&serial_tx)) {
+		tx_busy = 1;
+		outb(COM1+COM_IER, COM_IER_RDI | COM_IER_TXRDY);
+	}
+	spin_unlock_irqrestore(&serial_lock, eflags);
+}
+
+// Wait until everything queued has left the UART, e.g. before
+// powering off.  Feeds the FIFO itself in case interrupts are off.
+void
+serial_drain(void)
+{
+	uint32_t eflags;
+
+	if (!serial_exists)
+		return;
+	while (ring_count(&serial_tx) ||
+	       !(inb(COM1+COM_LSR) & COM_LSR_TSRE)) {
+		eflags = spin_lock_irqsave(&serial_lock);
+		if (inb(COM1+COM_LSR) & COM_LSR_TXRDY)
+			serial_start();
+		spin_unlock_irqrestore(&serial_lock, eflags);
+		pause();
+	}
+}
+
+void
+serial_intr(void)
+{
+	uint64_t irq_tsc = read_tsc();
+	uint8_t iir;
+
+	if (!serial_exists)
+		return;
+
+	while (!((iir = inb(COM1+COM_IIR)) & COM_IIR_NOPEND)) {
+		switch (iir & COM_IIR_ID) {
+		case COM_IIR_RXRDY:
+		case COM_IIR_RXTOUT:
+			cons_intr(serial_proc_data, irq_tsc);
+			break;
+		case COM_IIR_TXRDY:
+			spin_lock(&serial_lock);
+			serial_start();
+			spin_unlock(&serial_lock);
+			break;
+		case COM_IIR_RLS:
+			(void) inb(COM1+COM_LSR);
+			break;
+		case COM_IIR_MLSC:
+			(void) inb(COM1+COM_MSR);
+			break;
+		}
+	}
+}
+
+void
+serial_init(void)
+{
+	ring_init(&serial_tx, serial_txbuf, SERIAL_TXSIZE);
+
+	// Enable and clear the FIFOs
+	outb(COM1+COM_FCR, COM_FCR_ENABLE | COM_FCR_RCVRST |
+	     COM_FCR_XMTRST | COM_FCR_TRIG8);
+
+	// Set speed; requires DLAB latch
+	outb(COM1+COM_LCR, COM_LCR_DLAB);
+	outb(COM1+COM_DLL, (uint8_t) (115200 / 115200));	// 115200 baud
+	outb(COM1+COM_DLM, 0);
+
+	// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
+	outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
+
+	// Raise DTR and RTS, and OUT2 so the UART can interrupt
+	outb(COM1+COM_MCR, COM_MCR_DTR | COM_MCR_RTS | COM_MCR_OUT2);
+	// Enable rcv interrupts
+	outb(COM1+COM_IER, COM_IER_RDI);
+
+	// Clear any preexisting overrun indications and interrupts
+	// Serial port doesn't exist if COM_LSR returns 0xFF
+	serial_exists = (inb(COM1+COM_LSR) != 0xFF);
+	(void) inb(COM1+COM_IIR);
+	(void) inb(COM1+COM_RX);
+
+	if (serial_exists)
+		irq_setmask_8259A(irq_mask_8259A & ~(1<<IRQ_SERIAL));
+}
+
+
 /***** General device-independent console code *****/
 // Here we manage the console input buffer,
 // where we stash characters received from the keyboard or serial port
@@ -165,25 +370,26 @@ kbd_proc_data(void)
 
 #define CONSBUFSIZE 512
 
-static struct {
-	uint8_t buf[CONSBUFSIZE];
-	uint32_t rpos;
-	uint32_t wpos;
-} cons;
+// Lock-free: the only producers are the device interrupt handlers,
+// which run on the BSP and never nest, and the only consumer is the
+// shell reading through getc().
+static uint8_t consbuf[CONSBUFSIZE];
+static struct ring cons;
 
 // called by device interrupt routines to feed input characters
 // into the circular console input buffer.
+// When the buffer is full the new character is dropped, so unread
+// input is never overwritten; cons.r_overflow counts the losses.
 static void
-cons_intr(int (*proc)(void))
+cons_intr(int (*proc)(void), uint64_t irq_tsc)
 {
 	int c;
 
 	while ((c = (*proc)()) != -1) {
 		if (c == 0)
 			continue;
-		cons.buf[cons.wpos++] = c;
-		if (cons.wpos == CONSBUFSIZE)
-			cons.wpos = 0;
+		if (ring_put(&cons, c) == 0)
+			inputlat_decoded(irq_tsc);
 	}
 }
 
@@ -199,12 +405,8 @@ cons_getc(void)
 	//kbd_intr();
 
 	// grab the next character from the input buffer.
-	if (cons.rpos != cons.wpos) {
-		c = cons.buf[cons.rpos++];
-		if (cons.rpos == CONSBUFSIZE)
-			cons.rpos = 0;
+	if ((c = ring_get(&cons)) != -1)
 		return c;
-	}
 	return 0;
 }
 
@@ -214,14 +416,13 @@ cons_getc(void)
 void
 kbd_intr(void)
 {
-	cons_intr(kbd_proc_data);
+	cons_intr(kbd_proc_data, read_tsc());
 }
 
 void kbd_init(void)
 {
+	ring_init(&cons, consbuf, CONSBUFSIZE);
 	// Drain the kbd buffer so that Bochs generates interrupts.
-  cons.rpos = 0;
-  cons.wpos = 0;
 	kbd_intr();
 	irq_setmask_8259A(irq_mask_8259A & ~(1<<IRQ_KBD));
 }
@@ -231,7 +432,24 @@ int getc(void)
 {
 	int c;
 
-	while ((c = cons_getc()) == 0)
-		/* do nothing */;
-	return c;
+	// Show everything printed so far before waiting for input
+	log_drain();
+	console_flush();
+	for (;;) {
+		while ((c = cons_getc()) == 0)
+			/* do nothing */;
+		inputlat_read();
+		// PgUp/PgDn page through the scrollback; any other
+		// key goes back to the live screen
+		if (c == KEY_PGUP) {
+			inputlat_drop();
+			console_scrollback(24);
+		} else if (c == KEY_PGDN) {
+			inputlat_drop();
+			console_scrollback(-24);
+		} else {
+			console_live();
+			return c;
+		}
+	}
 }
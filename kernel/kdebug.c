@@ -0,0 +1,53 @@
+#include <inc/types.h>
+#include <kernel/kdebug.h>
+
+// The kernel's text symbols in address order, linked in by the build
+// (kernel/mkksyms.awk).  ks_name is an offset into ksym_names, whose
+// names are NUL-terminated.
+extern const struct Ksym ksyms[];
+extern const uint32_t nksyms;
+extern const char ksym_names[];
+
+extern char kernel_load_addr[], etext[];
+
+// debuginfo_eip(addr, info)
+//
+//	Fill in the 'info' structure with information about the
+//	function containing the specified instruction address, 'addr'.
+//	Returns 0 if information was found, and negative if not.
+//	But even if it returns negative it has stored some information
+//	into '*info'.
+//
+//	The function containing addr is the last symbol at or below it,
+//	found by binary search.
+int
+debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	const struct Ksym *ks;
+	uint32_t lo = 0, hi = nksyms, mid;
+
+	// Initialize *info
+	info->eip_fn_name = "<unknown>";
+	info->eip_fn_namelen = 9;
+	info->eip_fn_addr = addr;
+
+	if (addr < (uintptr_t) kernel_load_addr || addr >= (uintptr_t) etext)
+		return -1;
+
+	// Find the first symbol above addr; the one before it is ours
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ksyms[mid].ks_addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return -1;
+
+	ks = &ksyms[lo - 1];
+	info->eip_fn_name = ksym_names + ks->ks_name;
+	info->eip_fn_namelen = ks->ks_namelen;
+	info->eip_fn_addr = ks->ks_addr;
+	return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef JOS_KERN_KDEBUG_H
+#define JOS_KERN_KDEBUG_H
+
+#include <inc/types.h>
+
+// Debug information about a particular instruction pointer
+struct Eipdebuginfo {
+	const char *eip_fn_name;	// Name of function containing EIP
+	int eip_fn_namelen;		// Length of function name
+	uintptr_t eip_fn_addr;		// Address of start of function
+};
+
+// An entry in the kernel's symbol table
+struct Ksym {
+	uintptr_t ks_addr;
+	uint32_t ks_name;		// Offset of the name in ksym_names
+	uint32_t ks_namelen;		// Length of the name
+};
+
+int debuginfo_eip(uintptr_t eip, struct Eipdebuginfo *info);
+
+#endif
@@ -0,0 +1,199 @@
+// Kernel log: a lock-free ring of the text printed by cprintf().
+//
+// Producers claim consecutive records with one xadd on log_next and
+// fill them in place, so printing costs a copy and never waits for a
+// device.  The console (VGA and serial) is a sink that follows the log
+// from behind, drained from the timer tick, before reading input, or
+// by a producer that finds the sink falling far behind.
+//
+// When the ring wraps, the oldest records are overwritten.  A record's
+// lr_seq is cleared while it is being written and set to its index + 1
+// once it is complete, so readers copy a record out and then check
+// lr_seq again, like a seqlock, to detect that it changed under them.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/spinlock.h>
+#include <inc/timer.h>
+#include <kernel/cpu.h>
+#include <kernel/log.h>
+
+static struct LogRecord log_slots[LOG_SLOTS];
+static volatile uint32_t log_next;	// Index of the next record to claim
+static uint64_t log_boot_tsc;		// Timestamps count from here
+
+// Console sink state, protected by sink_lock
+static struct spinlock sink_lock = SPINLOCK_INIT("logsink");
+static volatile uint32_t sink_next;	// Next record to show
+static uint32_t sink_lost;		// Records overwritten before shown
+
+// Until the timer ticks, producers drain the log themselves.
+static bool log_async;
+
+void
+log_init(void)
+{
+	log_boot_tsc = read_tsc();
+}
+
+void
+log_write(const char *buf, int len)
+{
+	struct LogRecord *r;
+	uint32_t idx, n;
+	uint64_t tsc;
+	uint8_t cpu;
+	int chunk;
+
+	if (len <= 0)
+		return;
+	n = (len + LOG_TEXTSIZE - 1) / LOG_TEXTSIZE;
+	tsc = read_tsc();
+	cpu = cpunum();
+	for (idx = xadd(&log_next, n); len > 0; idx++) {
+		r = &log_slots[idx & (LOG_SLOTS - 1)];
+		r->lr_seq = 0;
+		__asm __volatile("" ::: "memory");
+		chunk = MIN(len, LOG_TEXTSIZE);
+		memcpy(r->lr_text, buf, chunk);
+		r->lr_len = chunk;
+		r->lr_cpu = cpu;
+		r->lr_tsc = tsc;
+		__asm __volatile("" ::: "memory");
+		r->lr_seq = idx + 1;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	// Push the log out now if nobody else will soon, or if the
+	// console is half a ring behind and about to lose output.
+	if (!log_async || log_next - sink_next > LOG_SLOTS / 2)
+		log_drain();
+}
+
+// Copy record idx into text.  Returns its length, -1 if it is still
+// being written, or -2 if it has already been overwritten.
+static int
+log_read(uint32_t idx, char *text, uint64_t *tsc)
+{
+	struct LogRecord *r = &log_slots[idx & (LOG_SLOTS - 1)];
+	uint32_t seq = r->lr_seq;
+	int len;
+
+	__asm __volatile("" ::: "memory");
+	if (seq != idx + 1)
+		return (seq == 0 || (int32_t) (seq - (idx + 1)) < 0) ? -1 : -2;
+	len = r->lr_len;
+	memcpy(text, r->lr_text, len);
+	if (tsc)
+		*tsc = r->lr_tsc;
+	__asm __volatile("" ::: "memory");
+	if (r->lr_seq != seq)
+		return -2;
+	return len;
+}
+
+// Show the records the console has not seen yet.  Called with
+// sink_lock held.  Output goes out in chunks of several records.
+static void
+log_drain_locked(void)
+{
+	char buf[512];
+	int n = 0, len;
+
+	while (sink_next != log_next) {
+		if (log_next - sink_next > LOG_SLOTS) {
+			sink_lost += log_next - LOG_SLOTS - sink_next;
+			sink_next = log_next - LOG_SLOTS;
+		}
+		if (n + LOG_TEXTSIZE > sizeof(buf)) {
+			console_write(buf, n);
+			n = 0;
+		}
+		len = log_read(sink_next, buf + n, NULL);
+		if (len == -1)
+			break;
+		if (len >= 0)
+			n += len;
+		else
+			sink_lost++;
+		sink_next++;
+	}
+	if (n)
+		console_write(buf, n);
+}
+
+// Bring the console up to date with the log.  Safe from interrupt
+// handlers; if another CPU is already draining, it leaves it to them.
+void
+log_drain(void)
+{
+	uint32_t eflags;
+
+	if (sink_next == log_next)
+		return;
+	eflags = irq_save();
+	if (spin_trylock(&sink_lock)) {
+		log_drain_locked();
+		spin_unlock(&sink_lock);
+	}
+	irq_restore(eflags);
+}
+
+// Called from the timer interrupt
+void
+log_tick(void)
+{
+	log_async = 1;
+	log_drain();
+}
+
+// Print the log with a timestamp at the start of each line.  Goes
+// straight to the console rather than through cprintf, which would
+// overwrite the oldest records while we read them.
+int
+mon_dmesg(int argc, char **argv)
+{
+	char text[LOG_TEXTSIZE], stamp[32];
+	uint32_t idx, end, skipped = 0;
+	unsigned long khz = get_tsc_khz();
+	uint64_t tsc, us;
+	int len, i, start, bol = 1;
+
+	log_drain();
+	end = log_next;
+	idx = end > LOG_SLOTS ? end - LOG_SLOTS : 0;
+	for (; idx != end; idx++) {
+		if ((len = log_read(idx, text, &tsc)) < 0) {
+			skipped++;
+			continue;
+		}
+		for (start = i = 0; i < len; i++) {
+			if (bol) {
+				us = khz ? (tsc - log_boot_tsc) * 1000 / khz : 0;
+				snprintf(stamp, sizeof(stamp), "[%5u.%06u] ",
+					 (uint32_t) (us / 1000000),
+					 (uint32_t) (us % 1000000));
+				console_write(stamp, strlen(stamp));
+				bol = 0;
+			}
+			if (text[i] == '\n') {
+				console_write(text + start, i + 1 - start);
+				start = i + 1;
+				bol = 1;
+			}
+		}
+		console_write(text + start, len - start);
+	}
+	if (!bol)
+		console_write("\n", 1);
+	if (argc > 1 && strcmp(argv[1], "stat") == 0) {
+		snprintf(text, sizeof(text),
+			 "%u records, %u skipped, %u lost by the console\n",
+			 end, skipped, sink_lost);
+		console_write(text, strlen(text));
+	}
+	return 0;
+}
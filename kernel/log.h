@@ -0,0 +1,30 @@
+#ifndef JOS_KERN_LOG_H
+#define JOS_KERN_LOG_H
+
+#include <inc/types.h>
+#include <inc/x86.h>
+
+// Bytes of text in one log record.  Longer messages take several
+// consecutive records.
+#define LOG_TEXTSIZE	112
+
+// Records kept in the log (must be a power of 2)
+#define LOG_SLOTS	1024
+
+struct LogRecord {
+	volatile uint32_t lr_seq;	// Index + 1 once written, 0 while writing
+	uint16_t lr_len;		// Bytes used in lr_text
+	uint8_t lr_cpu;			// CPU that logged it
+	uint8_t lr_pad;
+	uint64_t lr_tsc;		// When it was logged
+	char lr_text[LOG_TEXTSIZE];
+} __attribute__((aligned(CACHELINE)));
+
+void log_init(void);
+void log_write(const char *buf, int len);
+void log_drain(void);
+void log_tick(void);
+
+int mon_dmesg(int argc, char **argv);
+
+#endif	// !JOS_KERN_LOG_H
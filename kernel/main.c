@@ -1,23 +1,106 @@
 #include <inc/stdio.h>
+#include <inc/string.h>
 #include <inc/kbd.h>
 #include <inc/shell.h>
 #include <inc/timer.h>
 #include <inc/x86.h>
 #include <kernel/trap.h>
 #include <kernel/picirq.h>
+#include <kernel/cpu.h>
+#include <kernel/sched.h>
+#include <kernel/log.h>
+#include <kernel/trace.h>
+#include <kernel/ftrace.h>
+#include <kernel/benchrun.h>
 
 extern void init_video(void);
+static void boot_aps(void);
+
 void kernel_main(void)
 {
+	extern char edata[], end[];
+
+	/* The boot loader only loads what is in the file and leaves
+	 * .bss as whatever was in RAM; this is the only thing that
+	 * zeroes it, so it must come before anything uses a global */
+	memset(edata, 0, end - edata);
+	string_init();
+	log_init();
+
 	init_video();
+	serial_init();
+
+	mp_init();
+	lapic_init();
 
 	pic_init();
 	kbd_init();
 	timer_init();
 	trap_init();
+	trace_init();
+	ftrace_init();
+
+	/* Start the application processors */
+	boot_aps();
 
 	/* Enable interrupt */
 	__asm __volatile("sti");
 
+	/* Keep the boot in the function trace: the shell's input loop
+	 * would soon push it out */
+	ftrace_enable(0);
+
+	/* Under 'make qemu-bench' this runs the benchmarks and exits */
+	benchrun();
 	shell();
 }
+
+/* While boot_aps is booting a given CPU, it communicates the per-core
+ * stack pointer that should be loaded by mpentry.S to that CPU in
+ * this variable. */
+void *mpentry_kstack;
+
+/* Start the non-boot (AP) processors. */
+static void
+boot_aps(void)
+{
+	extern unsigned char mpentry_start[], mpentry_end[];
+	struct CpuInfo *c;
+	int wait;
+
+	/* Write entry code to unused memory at MPENTRY_PADDR */
+	memmove((void *) MPENTRY_PADDR, mpentry_start,
+		mpentry_end - mpentry_start);
+
+	/* Boot each AP one at a time */
+	for (c = cpus; c < cpus + ncpu; c++) {
+		if (c == bootcpu)
+			continue;
+
+		/* Tell mpentry.S what stack to use */
+		mpentry_kstack = percpu_kstacks[c - cpus] + KSTKSIZE;
+		/* Start the CPU at mpentry_start */
+		lapic_startap(c->cpu_apicid, MPENTRY_PADDR);
+		/* Wait (up to about a second) for the CPU to finish
+		 * some basic setup in mp_main() */
+		for (wait = 0; c->cpu_status != CPU_STARTED && wait < 1000000; wait++)
+			inb(0x84);
+		if (c->cpu_status != CPU_STARTED)
+			cprintf("SMP: CPU %d (APIC %d) did not start\n",
+				c->cpu_id, c->cpu_apicid);
+	}
+}
+
+/* Setup code for APs */
+void
+mp_main(void)
+{
+	trap_init_percpu();
+	string_init();
+	lapic_init();
+
+	xchg(&thiscpu->cpu_status, CPU_STARTED); /* tell boot_aps() we're up */
+
+	/* Run and steal tasks; never returns */
+	sched_idle();
+}
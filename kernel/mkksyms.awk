@@ -0,0 +1,35 @@
+# Turn 'nm -n' output into kernel/system's symbol table (see kdebug.c):
+# the text symbols in address order, each as its address and the
+# offset and length of its name in a pool of NUL-terminated strings.
+
+BEGIN {
+	n = 0
+}
+
+$2 ~ /^[TtWw]$/ && $3 !~ /^\.L/ {
+	addr[n] = $1
+	name[n] = $3
+	n++
+}
+
+END {
+	print "# Generated by kernel/mkksyms.awk; do not edit"
+	print "\t.section .rodata"
+	print "\t.p2align 2"
+	print "\t.globl ksyms"
+	print "ksyms:"
+	off = 0
+	for (i = 0; i < n; i++) {
+		printf "\t.long 0x%s, %d, %d\n", addr[i], off, length(name[i])
+		off += length(name[i]) + 1
+	}
+	print "\t.globl nksyms"
+	print "nksyms:"
+	printf "\t.long %d\n", n
+	print "\t.globl ksym_names"
+	print "ksym_names:"
+	for (i = 0; i < n; i++)
+		printf "\t.asciz \"%s\"\n", name[i]
+	# Keep ksym_names non-empty
+	print "\t.byte 0"
+}
@@ -1,16 +1,51 @@
 // Simple implementation of cprintf console output for the kernel,
-// based on printfmt() and the kernel console's cputchar().
+// based on printfmt() and the kernel log.
 #include <inc/types.h>
 #include <inc/stdio.h>
+#include <inc/string.h>
+#include <kernel/log.h>
 
+// Output is collected here and handed to the kernel log in chunks.
+// Each chunk is stored in consecutive log records, so a cprintf that
+// fits in the buffer never interleaves with one from another CPU.
+struct printbuf {
+	int idx;	// current buffer index
+	int cnt;	// total bytes printed so far
+	char buf[512];
+};
 
+static void
+printbuf_write(const char *s, int len, struct printbuf *b)
+{
+	int n;
+
+	b->cnt += len;
+	while (len > 0) {
+		n = MIN(len, sizeof(b->buf) - b->idx);
+		memcpy(b->buf + b->idx, s, n);
+		b->idx += n;
+		s += n;
+		len -= n;
+		if (b->idx == sizeof(b->buf)) {
+			log_write(b->buf, b->idx);
+			b->idx = 0;
+		}
+	}
+}
+
+// Only copies into the log: the console catches up asynchronously
+// (see kernel/log.c), so this never waits for a device or a lock.
 int
 vcprintf(const char *fmt, va_list ap)
 {
-	int cnt = 0;
+	struct printbuf b;
+	struct printsink sink = { (void *) printbuf_write, &b };
 
-	vprintfmt((void*)putch, &cnt, fmt, ap);
-	return cnt;
+	b.idx = 0;
+	b.cnt = 0;
+	vprintfmt_sink(&sink, fmt, ap);
+	log_write(b.buf, b.idx);
+	return b.cnt;
 }
 
 int
@@ -0,0 +1,324 @@
+// Statistical profiler.
+//
+// While it runs, every timer interrupt adds the interrupted EIP to a
+// histogram over the kernel text, with one counter per 2^prof_shift
+// bytes.  'prof report' adds the buckets up per function, using the
+// kernel symbol table, and shows the hottest.  The timer interrupt
+// only reaches the boot CPU, so only its time is sampled.
+//
+// 'prof start <hz>' samples faster than the tick by speeding up the
+// PIT; the timer code keeps the tick itself at TIME_HZ.
+//
+// Each sample's call stack is also counted, in a hash table of
+// distinct stacks, and 'prof folded' prints them in the folded format
+// flamegraph.pl reads ("outer;caller;leaf count").  Stacks are found by
+// following the saved %ebp chain, so they only go beyond the
+// interrupted EIP in a 'make FRAMEPTR=1' kernel.  A sample taken in a
+// function's prologue, before it has set up %ebp, misses its caller.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/timer.h>
+#include <kernel/cpu.h>
+#include <kernel/kdebug.h>
+#include <kernel/prof.h>
+
+extern char kernel_load_addr[], etext[];
+
+static uint32_t prof_hist[PROF_BUCKETS];
+static int prof_shift;			// log2 of the bytes per bucket
+static volatile bool prof_on;
+static uint32_t prof_samples;		// Samples taken
+static uint32_t prof_outside;		// ... with EIP outside the kernel text
+static uint64_t prof_start_tsc, prof_tsc;	// Time spent sampling
+
+struct ProfStack {
+	uint32_t ps_count;		// Samples; 0 if the slot is free
+	uint32_t ps_depth;
+	uintptr_t ps_pcs[PROF_DEPTH];	// Interrupted EIP, then return addresses
+};
+
+static struct ProfStack prof_stacks[PROF_STACKS];
+static uint32_t prof_stacks_lost;	// Samples whose stack didn't fit
+static bool prof_merged;		// ps_pcs hold function addresses
+
+#ifdef FRAMEPTR
+// Store the return addresses of the frames above the interrupted one
+// in pcs, following the saved %ebp chain up this CPU's kernel stack.
+// Returns how many were found.
+static int
+prof_walk(uint32_t ebp, uintptr_t *pcs, int max)
+{
+	uintptr_t top = thiscpu->cpu_kstacktop;
+	uint32_t *frame;
+	int n = 0;
+
+	while (n < max && ebp >= top - KSTKSIZE && ebp + 8 <= top &&
+	       (ebp & 3) == 0) {
+		frame = (uint32_t *) ebp;
+		pcs[n++] = frame[1];
+		// Callers' frames are further up the stack; anything
+		// else means the chain is broken
+		if (frame[0] <= ebp)
+			break;
+		ebp = frame[0];
+	}
+	return n;
+}
+#endif
+
+// Count one sample of the stack in pcs
+static void
+prof_count_stack(const uintptr_t *pcs, int depth)
+{
+	struct ProfStack *ps;
+	uint32_t h = depth;
+	int i, probe;
+
+	for (i = 0; i < depth; i++)
+		h = (h ^ pcs[i]) * 0x01000193;
+	for (probe = 0; probe < PROF_PROBES; probe++) {
+		ps = &prof_stacks[(h + probe) & (PROF_STACKS - 1)];
+		if (ps->ps_count == 0) {
+			ps->ps_depth = depth;
+			memcpy(ps->ps_pcs, pcs, depth * sizeof(pcs[0]));
+		} else if (ps->ps_depth != depth ||
+			   memcmp(ps->ps_pcs, pcs, depth * sizeof(pcs[0])) != 0)
+			continue;
+		ps->ps_count++;
+		return;
+	}
+	prof_stacks_lost++;
+}
+
+// Called from the timer interrupt
+void
+prof_sample(struct Trapframe *tf)
+{
+	uintptr_t pcs[PROF_DEPTH];
+	uint32_t off;
+	int depth = 1;
+
+	if (!prof_on)
+		return;
+	prof_samples++;
+	off = tf->tf_eip - (uintptr_t) kernel_load_addr;
+	if (tf->tf_eip < (uintptr_t) kernel_load_addr ||
+	    tf->tf_eip >= (uintptr_t) etext) {
+		prof_outside++;
+		return;
+	}
+	prof_hist[off >> prof_shift]++;
+
+	pcs[0] = tf->tf_eip;
+#ifdef FRAMEPTR
+	depth += prof_walk(tf->tf_regs.reg_ebp, pcs + 1, PROF_DEPTH - 1);
+#endif
+	prof_count_stack(pcs, depth);
+}
+
+bool
+prof_running(void)
+{
+	return prof_on;
+}
+
+static void
+prof_start(int hz)
+{
+	uint32_t text = etext - kernel_load_addr;
+
+	prof_on = 0;
+	memset(prof_hist, 0, sizeof(prof_hist));
+	memset(prof_stacks, 0, sizeof(prof_stacks));
+	prof_samples = prof_outside = prof_stacks_lost = 0;
+	prof_merged = 0;
+	for (prof_shift = 2; (text >> prof_shift) >= PROF_BUCKETS; prof_shift++)
+		;
+	timer_set_rate(hz / TIME_HZ);
+	prof_tsc = 0;
+	prof_start_tsc = read_tsc();
+	prof_on = 1;
+}
+
+static void
+prof_stop(void)
+{
+	if (!prof_on)
+		return;
+	prof_on = 0;
+	prof_tsc += read_tsc() - prof_start_tsc;
+	timer_set_rate(1);
+}
+
+// Per-function totals for the report
+#define PROF_FUNCS	512
+
+struct ProfFunc {
+	uintptr_t pf_addr;
+	const char *pf_name;	// NULL if unknown: pf_addr is a bucket
+	int pf_namelen;
+	uint32_t pf_count;
+};
+
+static struct ProfFunc prof_funcs[PROF_FUNCS];
+
+// Sum the buckets per function, counting a bucket for the function
+// at its start.  Returns the number of functions.
+static int
+prof_collect(void)
+{
+	struct Eipdebuginfo info;
+	uintptr_t addr;
+	int b, i, n = 0;
+
+	for (b = 0; b < PROF_BUCKETS; b++) {
+		if (!prof_hist[b])
+			continue;
+		addr = (uintptr_t) kernel_load_addr + (b << prof_shift);
+		if (debuginfo_eip(addr, &info) < 0)
+			info.eip_fn_name = NULL;
+		for (i = 0; i < n; i++)
+			if (prof_funcs[i].pf_addr == info.eip_fn_addr)
+				break;
+		if (i == n) {
+			if (n == PROF_FUNCS)
+				i = n - 1;	// Lump the rest together
+			else {
+				prof_funcs[n].pf_addr = info.eip_fn_addr;
+				prof_funcs[n].pf_name = info.eip_fn_name;
+				prof_funcs[n].pf_namelen = info.eip_fn_namelen;
+				prof_funcs[n].pf_count = 0;
+				n++;
+			}
+		}
+		prof_funcs[i].pf_count += prof_hist[b];
+	}
+	return n;
+}
+
+static void
+prof_report(int top)
+{
+	struct ProfFunc *f, t;
+	uint32_t total = prof_samples, pct;
+	unsigned long khz = get_tsc_khz();
+	uint64_t tsc = prof_tsc;
+	int i, j, n;
+
+	if (prof_on)
+		tsc += read_tsc() - prof_start_tsc;
+	cprintf("%u samples in %u ms, %u outside the kernel text, "
+		"%u stacks lost\n", total, khz ? (uint32_t) (tsc / khz) : 0,
+		prof_outside, prof_stacks_lost);
+	if (total == 0)
+		return;
+
+	// Selection sort the first top entries
+	n = prof_collect();
+	cprintf("SAMPLES     %%  FUNCTION\n");
+	for (i = 0; i < n && i < top; i++) {
+		for (j = i + 1; j < n; j++)
+			if (prof_funcs[j].pf_count > prof_funcs[i].pf_count) {
+				t = prof_funcs[i];
+				prof_funcs[i] = prof_funcs[j];
+				prof_funcs[j] = t;
+			}
+		f = &prof_funcs[i];
+		pct = (uint32_t) ((uint64_t) f->pf_count * 1000 / total);
+		if (f->pf_name)
+			cprintf("%7u %3u.%u  %.*s\n", f->pf_count, pct / 10,
+				pct % 10, f->pf_namelen, f->pf_name);
+		else
+			cprintf("%7u %3u.%u  0x%08x-0x%08x\n", f->pf_count,
+				pct / 10, pct % 10, f->pf_addr,
+				f->pf_addr + (1 << prof_shift) - 1);
+	}
+}
+
+// Replace each address in the stacks with the start of its function
+// and merge the stacks that become equal.  A return address can be
+// just past the end of its caller, so callers are looked up at pc - 1.
+static void
+prof_merge(void)
+{
+	struct Eipdebuginfo info;
+	struct ProfStack *ps, *qs;
+	int d;
+
+	for (ps = prof_stacks; ps < prof_stacks + PROF_STACKS; ps++)
+		for (d = 0; ps->ps_count && d < ps->ps_depth; d++)
+			if (debuginfo_eip(ps->ps_pcs[d] - (d > 0), &info) == 0)
+				ps->ps_pcs[d] = info.eip_fn_addr;
+	for (ps = prof_stacks; ps < prof_stacks + PROF_STACKS; ps++)
+		for (qs = ps + 1; ps->ps_count && qs < prof_stacks + PROF_STACKS; qs++)
+			if (qs->ps_count && qs->ps_depth == ps->ps_depth &&
+			    memcmp(qs->ps_pcs, ps->ps_pcs,
+				   ps->ps_depth * sizeof(ps->ps_pcs[0])) == 0) {
+				ps->ps_count += qs->ps_count;
+				qs->ps_count = 0;
+			}
+	prof_merged = 1;
+}
+
+// One line per distinct stack, outermost caller first.  Frames
+// without a known function are printed as addresses.
+static void
+prof_folded(void)
+{
+	struct Eipdebuginfo info;
+	struct ProfStack *ps;
+	char line[PROF_DEPTH * 40 + 16];
+	int d, n;
+
+	if (prof_on) {
+		cprintf("Stop the profiler first\n");
+		return;
+	}
+	if (!prof_merged)
+		prof_merge();
+	for (ps = prof_stacks; ps < prof_stacks + PROF_STACKS; ps++) {
+		if (!ps->ps_count)
+			continue;
+		n = 0;
+		for (d = ps->ps_depth - 1; d >= 0; d--) {
+			if (debuginfo_eip(ps->ps_pcs[d], &info) == 0)
+				n += snprintf(line + n, sizeof(line) - n, "%.*s",
+					      MIN(info.eip_fn_namelen, 38),
+					      info.eip_fn_name);
+			else
+				n += snprintf(line + n, sizeof(line) - n,
+					      "0x%08x", ps->ps_pcs[d]);
+			line[n++] = d ? ';' : ' ';
+		}
+		snprintf(line + n, sizeof(line) - n, "%u\n", ps->ps_count);
+		cprintf("%s", line);
+	}
+}
+
+int
+mon_prof(int argc, char **argv)
+{
+	int hz;
+
+	if (argc > 1 && strcmp(argv[1], "start") == 0) {
+		hz = argc > 2 ? strtol(argv[2], NULL, 0) : TIME_HZ;
+		if (hz < TIME_HZ || hz > PROF_MAXHZ) {
+			cprintf("Sampling rate must be %d to %d Hz\n",
+				TIME_HZ, PROF_MAXHZ);
+			return 0;
+		}
+		prof_start(hz);
+		cprintf("Sampling at %d Hz\n", hz / TIME_HZ * TIME_HZ);
+	} else if (argc > 1 && strcmp(argv[1], "stop") == 0)
+		prof_stop();
+	else if (argc > 1 && strcmp(argv[1], "report") == 0)
+		prof_report(argc > 2 ? strtol(argv[2], NULL, 0) : 20);
+	else if (argc > 1 && strcmp(argv[1], "folded") == 0)
+		prof_folded();
+	else
+		cprintf("Usage: prof start [hz] | stop | report [count] | folded\n");
+	return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef JOS_KERN_PROF_H
+#define JOS_KERN_PROF_H
+
+#include <inc/types.h>
+#include <inc/trap.h>
+
+// Histogram buckets over the kernel text
+#define PROF_BUCKETS	8192
+
+// Highest sampling rate 'prof start' accepts
+#define PROF_MAXHZ	10000
+
+// Call stacks: frames kept per sample, distinct stacks kept (a power
+// of 2), and slots tried before a new stack is dropped
+#define PROF_DEPTH	16
+#define PROF_STACKS	1024
+#define PROF_PROBES	32
+
+void prof_sample(struct Trapframe *tf);
+bool prof_running(void);
+
+int mon_prof(int argc, char **argv);
+
+#endif	// !JOS_KERN_PROF_H
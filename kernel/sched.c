@@ -0,0 +1,317 @@
+/*
+ * Per-CPU run queues with work stealing.
+ *
+ * Each CPU owns a Chase-Lev deque ("Dynamic Circular Work-Stealing
+ * Deque", SPAA 2005) of run-to-completion tasks.  The owner pushes and
+ * pops at the bottom end without atomic instructions except when it
+ * races a thief for the last task; idle CPUs steal from the top end.
+ * x86 only reorders a store with a later load, so the single fence
+ * the algorithm needs is in rq_pop().
+ */
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/spinlock.h>
+#include <inc/trap.h>
+#include <inc/timer.h>
+#include <kernel/cpu.h>
+#include <kernel/sched.h>
+#include <kernel/trace.h>
+
+#define RQ_MASK		(RQ_SIZE - 1)
+
+// Empty polls before an idle CPU halts and waits for a wakeup IPI
+#define IDLE_SPINS	1000
+
+struct RunQueue runqueues[NCPU];
+volatile int sched_ncpu = NCPU;
+
+// Owner only: add t at the bottom.  Returns -1 if the queue is full.
+static int
+rq_push(struct RunQueue *rq, struct Task *t)
+{
+	int32_t b = rq->rq_bottom;
+	int32_t top = rq->rq_top;
+
+	if (b - top >= RQ_SIZE)
+		return -1;
+	rq->rq_tasks[b & RQ_MASK] = t;
+	// Stores are not reordered with other stores, so a thief that
+	// sees the new bottom also sees the task.  Only stop the compiler.
+	__asm __volatile("" ::: "memory");
+	rq->rq_bottom = b + 1;
+	return 0;
+}
+
+// Owner only: take the most recently pushed task, or NULL.
+static struct Task *
+rq_pop(struct RunQueue *rq)
+{
+	int32_t b = rq->rq_bottom - 1;
+	int32_t top;
+	struct Task *t;
+
+	// Publish the claim on slot b before reading rq_top.  This is
+	// the one store->load ordering x86 doesn't give us for free, so
+	// use xchg, which is a full barrier.
+	xchg((volatile uint32_t *) &rq->rq_bottom, b);
+	top = rq->rq_top;
+	if (b < top) {
+		// Empty: undo the claim
+		rq->rq_bottom = b + 1;
+		return NULL;
+	}
+	t = rq->rq_tasks[b & RQ_MASK];
+	if (b > top)
+		return t;
+
+	// Only one task left: race the thieves for it through rq_top.
+	if (cmpxchg((volatile uint32_t *) &rq->rq_top, top, top + 1) != top)
+		t = NULL;
+	rq->rq_bottom = b + 1;
+	return t;
+}
+
+// Any CPU: take the oldest task from rq, or NULL if it is empty
+// or another CPU got there first.
+static struct Task *
+rq_steal(struct RunQueue *rq)
+{
+	int32_t top = rq->rq_top;
+	int32_t b;
+	struct Task *t;
+
+	// Loads are not reordered with other loads
+	__asm __volatile("" ::: "memory");
+	b = rq->rq_bottom;
+	if (top >= b)
+		return NULL;
+	t = rq->rq_tasks[top & RQ_MASK];
+	if (cmpxchg((volatile uint32_t *) &rq->rq_top, top, top + 1) != top)
+		return NULL;
+	return t;
+}
+
+// Try every other started CPU once, starting from a random victim.
+static struct Task *
+sched_steal(struct RunQueue *self)
+{
+	uint32_t x = self->rq_seed;
+	struct Task *t;
+	int i, victim;
+
+	if (x == 0)
+		x = 2463534242U + (self - runqueues);
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	self->rq_seed = x;
+
+	victim = x % ncpu;
+	for (i = 0; i < ncpu; i++, victim = (victim + 1) % ncpu) {
+		if (&runqueues[victim] == self ||
+		    cpus[victim].cpu_status != CPU_STARTED)
+			continue;
+		if ((t = rq_steal(&runqueues[victim])) != NULL) {
+			trace("sched: stole %p from CPU %d", t, victim);
+			return t;
+		}
+	}
+	return NULL;
+}
+
+// Queue t on this CPU.  If the queue is full, run t right away.
+void
+sched_spawn(struct Task *t)
+{
+	struct RunQueue *rq = &runqueues[thiscpu->cpu_id];
+	int i;
+
+	if (rq_push(rq, t) < 0) {
+		rq->rq_inline++;
+		trace("sched: queue full, running %p inline", t);
+		t->task_func(t->task_arg);
+		return;
+	}
+
+	// Wake one halted CPU to come and steal.  The fence orders the
+	// push before the rq_sleeping loads; sched_idle() likewise sets
+	// rq_sleeping before its last look at the queues, so either it
+	// sees this task or we see it sleeping.
+	mfence();
+	for (i = 0; i < ncpu; i++)
+		if (i < sched_ncpu && runqueues[i].rq_sleeping &&
+		    xchg(&runqueues[i].rq_sleeping, 0)) {
+			lapic_ipi(cpus[i].cpu_apicid, T_WAKEUP);
+			break;
+		}
+}
+
+// Run one task from this CPU's queue, or stolen from another CPU.
+// Returns 1 if a task ran, 0 if there was nothing to do.
+int
+sched_run_one(void)
+{
+	struct CpuInfo *c = thiscpu;
+	struct RunQueue *rq = &runqueues[c->cpu_id];
+	struct Task *t;
+	uint64_t start;
+
+	if (c != bootcpu && c->cpu_id >= sched_ncpu)
+		return 0;
+	if ((t = rq_pop(rq)) == NULL) {
+		if ((t = sched_steal(rq)) == NULL)
+			return 0;
+		rq->rq_stolen++;
+	}
+
+	start = read_tsc();
+	t->task_func(t->task_arg);
+	rq->rq_busy += read_tsc() - start;
+	rq->rq_ran++;
+	return 1;
+}
+
+// Idle loop of the application processors.  Interrupts stay off
+// except while halted, where only a T_WAKEUP IPI can arrive.
+void
+sched_idle(void)
+{
+	struct RunQueue *rq = &runqueues[thiscpu->cpu_id];
+	int spins = 0;
+
+	rq->rq_stamp = read_tsc();
+	for (;;) {
+		if (sched_run_one()) {
+			spins = 0;
+			continue;
+		}
+		if (++spins < IDLE_SPINS) {
+			pause();
+			continue;
+		}
+
+		trace("sched: CPU %d going idle", thiscpu->cpu_id);
+		xchg(&rq->rq_sleeping, 1);
+		if (!sched_run_one()) {
+			// sti takes effect after hlt starts, so a wakeup
+			// sent after the check above still ends the halt.
+			irqsoff_end(0);
+			__asm __volatile("sti; hlt; cli");
+			irqsoff_begin(0);
+		}
+		rq->rq_sleeping = 0;
+		spins = 0;
+	}
+}
+
+// part * 100 / whole without 64-bit division
+static unsigned
+percent(uint64_t part, uint64_t whole)
+{
+	while (whole >> 25) {
+		part >>= 1;
+		whole >>= 1;
+	}
+	return whole ? (uint32_t) part * 100 / (uint32_t) whole : 0;
+}
+
+int
+mon_runq(int argc, char **argv)
+{
+	struct RunQueue *rq;
+	uint64_t now = read_tsc();
+	int i;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		for (i = 0; i < ncpu; i++) {
+			rq = &runqueues[i];
+			rq->rq_ran = rq->rq_stolen = rq->rq_inline = 0;
+			rq->rq_busy = 0;
+			rq->rq_stamp = now;
+		}
+		return 0;
+	}
+
+	cprintf("CPU QUEUED      RAN   STOLEN   INLINE BUSY\n");
+	for (i = 0; i < ncpu; i++) {
+		rq = &runqueues[i];
+		cprintf("%2d%c %6d %8u %8u %8u %3u%%%s\n", i,
+			&cpus[i] == bootcpu ? '*' : ' ',
+			rq->rq_bottom - rq->rq_top, rq->rq_ran,
+			rq->rq_stolen, rq->rq_inline,
+			percent(rq->rq_busy, now - rq->rq_stamp),
+			rq->rq_sleeping ? " (halted)" : "");
+	}
+	return 0;
+}
+
+/***** Scaling benchmark *****/
+
+#define BENCH_MAXTASKS	8192
+
+static struct Task bench_tasks[BENCH_MAXTASKS];
+static volatile uint32_t bench_done;
+static int bench_work;
+
+static void
+bench_task(void *arg)
+{
+	volatile uint32_t x = (uint32_t) arg | 1;
+	int i;
+
+	for (i = 0; i < bench_work; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	xadd(&bench_done, 1);
+}
+
+// Spawn ntasks short tasks from the BSP with 1, 2, ... ncpu CPUs
+// taking work, and report throughput for each.
+int
+mon_taskbench(int argc, char **argv)
+{
+	unsigned ntasks = argc > 1 ? strtol(argv[1], NULL, 0) : 4096;
+	unsigned khz = get_tsc_khz();
+	uint64_t start, cycles, base = 0;
+	unsigned i;
+	int n;
+
+	bench_work = argc > 2 ? strtol(argv[2], NULL, 0) : 1000;
+	if (ntasks == 0 || ntasks > BENCH_MAXTASKS) {
+		cprintf("Usage: taskbench [ntasks (1-%d)] [work]\n", BENCH_MAXTASKS);
+		return 0;
+	}
+	if (thiscpu != bootcpu) {
+		cprintf("taskbench must run on the BSP\n");
+		return 0;
+	}
+
+	cprintf("%u tasks of %d iterations, TSC %u kHz\n", ntasks, bench_work, khz);
+	for (n = 1; n <= ncpu; n++) {
+		sched_ncpu = n;
+		bench_done = 0;
+		start = read_tsc();
+		for (i = 0; i < ntasks; i++) {
+			bench_tasks[i].task_func = bench_task;
+			bench_tasks[i].task_arg = (void *) i;
+			sched_spawn(&bench_tasks[i]);
+		}
+		while (bench_done < ntasks)
+			if (!sched_run_one())
+				pause();
+		cycles = read_tsc() - start;
+		if (n == 1)
+			base = cycles;
+
+		cprintf("%d cpu(s): %llu cycles, %llu cycles/task, %llu tasks/ms, speedup %u.%02ux\n",
+			n, cycles, cycles / ntasks,
+			khz ? (uint64_t) ntasks * khz / cycles : 0,
+			(uint32_t) (base / cycles),
+			(uint32_t) (base * 100 / cycles % 100));
+	}
+	sched_ncpu = NCPU;
+	return 0;
+}
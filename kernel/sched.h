@@ -0,0 +1,51 @@
+#ifndef JOS_KERN_SCHED_H
+#define JOS_KERN_SCHED_H
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <kernel/cpu.h>
+
+// Tasks are run-to-completion kernel functions.  The caller owns the
+// struct Task and must keep it alive until task_func has been called.
+struct Task {
+	void (*task_func)(void *arg);
+	void *task_arg;
+};
+
+// Slots in each CPU's run queue (must be a power of 2)
+#define RQ_SIZE		1024
+
+// Per-CPU run queue: a fixed-size Chase-Lev work-stealing deque.
+// The owning CPU pushes and pops at rq_bottom without locks; other
+// CPUs steal from rq_top with a compare-and-swap.  The two ends sit
+// on separate cache lines so thieves don't bounce the owner's line.
+struct RunQueue {
+	volatile int32_t rq_top;	// Next slot to steal
+	uint8_t rq_pad0[CACHELINE - 4];
+	volatile int32_t rq_bottom;	// Next free slot at the owner end
+	volatile uint32_t rq_sleeping;	// Owner is halted waiting for work
+	uint32_t rq_seed;		// Victim selection (xorshift)
+	uint8_t rq_pad1[CACHELINE - 12];
+	struct Task *rq_tasks[RQ_SIZE];
+
+	// Load accounting, only written by the owner
+	uint32_t rq_ran;		// Tasks run on this CPU
+	uint32_t rq_stolen;		// ... of which were stolen from others
+	uint32_t rq_inline;		// Spawns run inline: queue was full
+	uint64_t rq_busy;		// Cycles spent in task_func
+	uint64_t rq_stamp;		// Start of the accounting window
+} __attribute__((aligned(CACHELINE)));
+
+extern struct RunQueue runqueues[NCPU];
+
+// CPUs with cpu_id >= sched_ncpu (other than the BSP) take no work
+extern volatile int sched_ncpu;
+
+void sched_spawn(struct Task *t);
+int sched_run_one(void);
+void sched_idle(void) __attribute__((noreturn));
+
+int mon_runq(int argc, char **argv);
+int mon_taskbench(int argc, char **argv);
+
+#endif	// !JOS_KERN_SCHED_H
@@ -2,6 +2,9 @@
 #include <inc/x86.h>
 #include <inc/string.h>
 #include <inc/stdio.h>
+#include <inc/spinlock.h>
+#include <kernel/log.h>
+#include <kernel/inputlat.h>
 
 /* These define our textpointer, our background and foreground
 *  colors (attributes), and x and y cursor coordinates */
@@ -9,7 +12,86 @@ unsigned short *textmemptr;
 int attrib = 0x0F;
 int csr_x = 0, csr_y = 0;
 
-/* Scrolls the screen */
+/* textmemptr points at a RAM shadow of the screen, which holds the
+*  authoritative contents. Reading VGA memory is slow MMIO, so text is
+*  drawn and scrolled in the shadow and console_flush() copies just the
+*  rows that changed (bit n of dirty_rows is row n) to the card, at most
+*  once per timer tick or when someone waits for input */
+static unsigned short shadow[25 * 80];
+static unsigned short *vgamem;
+static uint32_t dirty_rows;
+static int csr_moved;
+
+/* The card shows 25 rows starting at cell vga_origin of its 32KB text
+*  buffer (the CRTC start address). Rather than copying the screen up a
+*  line on every scroll, flush_locked() moves that window down by the
+*  rows scrolled since the last flush, so only the new rows need to be
+*  written. Once the window would run off the end of the buffer it
+*  goes back to 0 and the whole screen is copied */
+#define VGA_CELLS	(0x8000 / 2)
+static int vga_origin;
+static int rows_scrolled;
+
+/* Lines that scroll off the top are kept in a ring of SCROLLBACK_LINES
+*  (make SCROLLBACK=n to change it), which PgUp/PgDn page through.
+*  While view_back is non-zero the card shows the screen that many lines
+*  back; output still goes to the shadow, which is shown again on
+*  return to the live view. Each line costs 160 bytes of .bss, and the
+*  kernel lives in low memory with no allocator, so the ring is capped
+*  at 10MB */
+#ifndef SCROLLBACK_LINES
+#define SCROLLBACK_LINES 10000
+#endif
+#if SCROLLBACK_LINES < 1 || SCROLLBACK_LINES > 65536
+#error "SCROLLBACK must be between 1 and 65536 lines"
+#endif
+static unsigned short history[SCROLLBACK_LINES][80];
+static int hist_next;		/* Slot for the next line to scroll off */
+static int hist_count;		/* Lines saved, up to SCROLLBACK_LINES */
+static int view_back;
+static int view_dirty;
+
+/* Until the timer ticks nothing would flush, so write through */
+static int write_through = 1;
+
+/* Protects the cursor, the attribute, the shadow and video memory.
+*  Any CPU may print, and so may interrupt handlers, hence irqsave */
+static struct spinlock screen_lock = SPINLOCK_INIT("screen");
+
+#define ALL_ROWS	((1 << 25) - 1)
+
+/* Fills count character cells with val */
+static void fillw(unsigned short *dst, unsigned short val, int count)
+{
+    while (count-- > 0)
+        *dst++ = val;
+}
+
+/* Copies the top count rows of the shadow into the scrollback ring.
+*  Called with screen_lock held */
+static void save_lines(int count)
+{
+    int y;
+
+    for (y = 0; y < count && y < 25; y++) {
+        memcpy(history[hist_next], textmemptr + y * 80, 80 * 2);
+        if (++hist_next == SCROLLBACK_LINES)
+            hist_next = 0;
+    }
+    hist_count += y;
+    if (hist_count > SCROLLBACK_LINES)
+        hist_count = SCROLLBACK_LINES;
+
+    /* Keep a scrolled-back view on the same lines */
+    if (view_back) {
+        view_back += y;
+        if (view_back > hist_count)
+            view_back = hist_count;
+        view_dirty = 1;
+    }
+}
+
+/* Scrolls the screen. Called with screen_lock held */
 void scroll(void)
 {
     unsigned short blank, temp;
@@ -24,17 +106,37 @@ void scroll(void)
         /* Move the current text chunk that makes up the screen
         *  back in the buffer by a line */
         temp = csr_y - 25 + 1;
-        memcpy (textmemptr, textmemptr + temp * 80, (25 - temp) * 80 * 2);
+        save_lines(temp);
+        memmove (textmemptr, textmemptr + temp * 80, (25 - temp) * 80 * 2);
 
         /* Finally, we set the chunk of memory that occupies
         *  the last line of text to our 'blank' character */
-        memset (textmemptr + (25 - temp) * 80, blank, 80);
+        fillw (textmemptr + (25 - temp) * 80, blank, temp * 80);
         csr_y = 25 - 1;
+
+        /* Rows that moved up keep their dirty state: the card will
+        *  show them moved up too once the window is panned */
+        if (temp >= 25)
+            dirty_rows = ALL_ROWS;
+        else
+            dirty_rows = (dirty_rows >> temp) |
+                         (ALL_ROWS & ~((1 << (25 - temp)) - 1));
+        rows_scrolled += temp;
     }
 }
 
+/* Points the CRTC start address (registers 12 and 13) at vga_origin */
+static void set_origin(void)
+{
+    outb(0x3D4, 12);
+    outb(0x3D5, vga_origin >> 8);
+    outb(0x3D4, 13);
+    outb(0x3D5, vga_origin);
+}
+
 /* Updates the hardware cursor: the little blinking line
-*  on the screen under the last character pressed! */
+*  on the screen under the last character pressed!
+*  Called with screen_lock held, from flush_locked() */
 void move_csr(void)
 {
     unsigned short temp;
@@ -42,7 +144,7 @@ void move_csr(void)
     /* The equation for finding the index in a linear
     *  chunk of memory can be represented by:
     *  Index = [(y * width) + x] */
-    temp = csr_y * 80 + csr_x;
+    temp = vga_origin + csr_y * 80 + csr_x;
 
     /* This sends a command to indicies 14 and 15 in the
     *  CRT Control Register of the VGA controller. These
@@ -57,11 +159,140 @@ void move_csr(void)
     outb(0x3D5, temp);
 }
 
+/* Draws the screen view_back lines back in time, taking the rows
+*  above the live screen from the scrollback ring, and parks the
+*  hardware cursor off screen. Called with screen_lock held */
+static void draw_view(void)
+{
+    unsigned short *src;
+    int y, line, temp;
+
+    for (y = 0; y < 25; y++) {
+        line = y - view_back;
+        if (line >= 0)
+            src = textmemptr + line * 80;
+        else {
+            line += hist_next;
+            if (line < 0)
+                line += SCROLLBACK_LINES;
+            src = history[line];
+        }
+        memcpy(vgamem + vga_origin + y * 80, src, 80 * 2);
+    }
+    view_dirty = 0;
+
+    temp = vga_origin + 25 * 80;
+    outb(0x3D4, 14);
+    outb(0x3D5, temp >> 8);
+    outb(0x3D4, 15);
+    outb(0x3D5, temp);
+}
+
+/* Copies the dirty rows of the shadow to video memory and moves
+*  the hardware cursor if it changed. Called with screen_lock held */
+static void flush_locked(void)
+{
+    uint32_t rows;
+    int y;
+
+    /* Leave a scrolled-back view alone; the live screen is
+    *  brought up to date on return to it */
+    if (view_back) {
+        if (view_dirty)
+            draw_view();
+        return;
+    }
+
+    if (rows_scrolled) {
+        if (rows_scrolled < 25 &&
+            vga_origin + (rows_scrolled + 25) * 80 <= VGA_CELLS)
+            vga_origin += rows_scrolled * 80;
+        else {
+            vga_origin = 0;
+            dirty_rows = ALL_ROWS;
+        }
+        rows_scrolled = 0;
+        set_origin();
+        csr_moved = 1;
+    }
+
+    rows = dirty_rows;
+    dirty_rows = 0;
+    for (y = 0; rows; y++, rows >>= 1)
+        if (rows & 1)
+            memcpy(vgamem + vga_origin + y * 80, textmemptr + y * 80, 80 * 2);
+    if (y)
+        inputlat_shown();
+    if (csr_moved) {
+        csr_moved = 0;
+        move_csr();
+    }
+}
+
+/* Pushes pending output to the screen. Safe from interrupt handlers:
+*  if another CPU is drawing, it leaves the work to the next flush */
+void console_flush(void)
+{
+    uint32_t eflags;
+
+    if (!dirty_rows && !csr_moved && !rows_scrolled)
+        return;
+    eflags = irq_save();
+    if (spin_trylock(&screen_lock)) {
+        flush_locked();
+        spin_unlock(&screen_lock);
+    }
+    irq_restore(eflags);
+}
+
+/* Moves the view lines further back into the scrollback (forward
+*  if negative). Reaching the bottom returns to the live screen */
+void console_scrollback(int lines)
+{
+    uint32_t eflags;
+    int back;
+
+    eflags = spin_lock_irqsave(&screen_lock);
+    back = view_back + lines;
+    if (back > hist_count)
+        back = hist_count;
+    if (back < 0)
+        back = 0;
+    if (back != view_back) {
+        view_back = back;
+        if (back)
+            draw_view();
+        else {
+            dirty_rows = ALL_ROWS;
+            csr_moved = 1;
+            flush_locked();
+        }
+    }
+    spin_unlock_irqrestore(&screen_lock, eflags);
+}
+
+/* Returns to the live screen if the view is scrolled back */
+void console_live(void)
+{
+    if (view_back)
+        console_scrollback(-view_back);
+}
+
+/* Called from the timer interrupt */
+void console_tick(void)
+{
+    write_through = 0;
+    console_flush();
+}
+
 /* Clears the screen */
 void cls()
 {
     unsigned short blank;
     int i;
+    uint32_t eflags;
+
+    eflags = spin_lock_irqsave(&screen_lock);
 
     /* Again, we need the 'short' that will be used to
     *  represent a space with color */
@@ -70,20 +301,24 @@ void cls()
     /* Sets the entire screen to spaces in our current
     *  color */
     for(i = 0; i < 25; i++)
-        memset (textmemptr + i * 80, blank, 80);
+        fillw (textmemptr + i * 80, blank, 80);
+    dirty_rows = ALL_ROWS;
 
     /* Update out virtual cursor, and then move the
     *  hardware cursor */
     csr_x = 0;
     csr_y = 0;
-    move_csr();
+    csr_moved = 1;
+    flush_locked();
+
+    spin_unlock_irqrestore(&screen_lock, eflags);
 }
 
-/* Puts a single character on the screen */
-void putch(unsigned char c)
+/* Draws a single character at the cursor, leaving the hardware
+*  cursor alone. Called with screen_lock held */
+static void render(unsigned char c, unsigned short att)
 {
     unsigned short *where;
-    unsigned short att = attrib << 8;
 
     /* Handle a backspace, by moving the cursor back one space */
     if(c == 0x08)
@@ -92,6 +327,7 @@ void putch(unsigned char c)
           where = (textmemptr-1) + (csr_y * 80 + csr_x);
           *where = 0x0 | att;	/* Character AND attributes: color */
           csr_x--;
+          dirty_rows |= 1 << csr_y;
         }
     }
     /* Handles a tab by incrementing the cursor's x, but only
@@ -123,6 +359,7 @@ void putch(unsigned char c)
         where = textmemptr + (csr_y * 80 + csr_x);
         *where = c | att;	/* Character AND attributes: color */
         csr_x++;
+        dirty_rows |= 1 << csr_y;
     }
 
     /* If the cursor has reached the edge of the screen's width, we
@@ -133,20 +370,82 @@ void putch(unsigned char c)
         csr_y++;
     }
 
-    /* Scroll the screen if needed, and finally move the cursor */
-    scroll();
-    move_csr();
+    /* Scroll the screen if needed */
+    if(csr_y >= 25)
+        scroll();
 }
 
-/* Uses the above routine to output a string... */
-void puts(unsigned char *text)
+/* Draws a run of characters into the shadow under a single lock
+*  hold. The hardware cursor and video memory are updated later, by
+*  console_flush(): the four port writes in move_csr() and the MMIO
+*  writes cost far more than drawing into RAM. An echo of a key is
+*  stamped under the same hold, so no flush can come between the
+*  stamp and the glyph reaching the shadow */
+static void screen_draw(const char *buf, int len, int echo)
 {
+    unsigned short att;
+    uint32_t eflags;
     int i;
 
-    for (i = 0; i < strlen(text); i++)
-    {
-        putch(text[i]);
-    }
+    eflags = spin_lock_irqsave(&screen_lock);
+    att = attrib << 8;
+    for (i = 0; i < len; i++)
+        render(buf[i], att);
+    if (echo)
+        inputlat_echo();
+    csr_moved = 1;
+    if (write_through)
+        flush_locked();
+    spin_unlock_irqrestore(&screen_lock, eflags);
+}
+
+void screen_write(const char *buf, int len)
+{
+    screen_draw(buf, len, 0);
+}
+
+/* While set, console output is thrown away, so that 'repeat -q' can
+*  time a command without the cost of showing what it prints */
+static volatile int console_null;
+
+/* Returns the previous setting, for the caller to put back */
+int console_set_null(int null)
+{
+    int was = console_null;
+
+    console_null = null;
+    return was;
+}
+
+/* Everything shown on the screen also goes out COM1 */
+static void console_draw(const char *buf, int len, int echo)
+{
+    if (console_null)
+        return;
+    screen_draw(buf, len, echo);
+    serial_write(buf, len);
+}
+
+void console_write(const char *buf, int len)
+{
+    console_draw(buf, len, 0);
+}
+
+/* Puts a single character on the screen, after anything still
+*  waiting in the kernel log so the two stay in order. This is how
+*  readline echoes keys, so the key just read counts as echoed here,
+*  not on the log's or another CPU's writes */
+void putch(unsigned char c)
+{
+    log_drain();
+    console_draw((const char *)&c, 1, 1);
+}
+
+/* Uses the above routine to output a string... */
+void puts(unsigned char *text)
+{
+    log_drain();
+    console_write((const char *)text, strlen((const char *)text));
 }
 
 /* Sets the forecolor and backcolor that we will use */
@@ -161,6 +460,9 @@ void settextcolor(unsigned char forecolor, unsigned char backcolor)
 /* Sets our text-mode VGA pointer, then clears the screen for us */
 void init_video(void)
 {
-    textmemptr = (unsigned short *)0xB8000;
+    vgamem = (unsigned short *)0xB8000;
+    textmemptr = shadow;
+    vga_origin = 0;
+    set_origin();
     cls();
 }
@@ -1,7 +1,19 @@
 #include <inc/stdio.h>
 #include <inc/string.h>
+#include <inc/x86.h>
 #include <inc/shell.h>
 #include <inc/timer.h>
+#include <inc/spinlock.h>
+#include <kernel/cpu.h>
+#include <kernel/sched.h>
+#include <kernel/log.h>
+#include <kernel/trace.h>
+#include <kernel/bench.h>
+#include <kernel/prof.h>
+#include <kernel/ftrace.h>
+#include <kernel/irqsoff.h>
+#include <kernel/inputlat.h>
+#include <kernel/benchrun.h>
 
 struct Command {
 	const char *name;
@@ -14,7 +26,21 @@ static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "print_tick", "Display system tick", print_tick },
-	{ "chgcolor", "Change text color",  chgcolor }
+	{ "chgcolor", "Change text color",  chgcolor },
+	{ "cpus", "Display the processors and their state", mon_cpus },
+	{ "runq", "Display per-CPU run queue load ('runq reset' to clear)", mon_runq },
+	{ "taskbench", "Measure task throughput as CPUs are added", mon_taskbench },
+	{ "lockstat", "Display lock contention ('lockstat reset' to clear)", mon_lockstat },
+	{ "dmesg", "Display the kernel log ('dmesg stat' adds counters)", mon_dmesg },
+	{ "trace", "Control and dump the binary trace buffers", mon_trace },
+	{ "fmtbench", "Time printf number formatting against the old code", mon_fmtbench },
+	{ "bench", "Time core primitives in cycles ('bench <prefix>' runs some)", mon_bench },
+	{ "prof", "Sample where kernel time goes: prof start [hz] | stop | report [n] | folded", mon_prof },
+	{ "ftrace", "Function call tracing: ftrace on|off|clear|report [n]", mon_ftrace },
+	{ "irqsoff", "Display the longest interrupts-off section per CPU ('irqsoff reset' to clear)", mon_irqsoff },
+	{ "inputlat", "Display keypress-to-screen latency by stage ('inputlat reset' to clear)", mon_inputlat },
+	{ "time", "Run a command and display the time and interrupts it took", mon_time },
+	{ "repeat", "Run a command N times and display min/avg/max: repeat [-q] N cmd ('-q' drops its output)", mon_repeat }
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -41,14 +67,74 @@ int print_tick(int argc, char **argv)
 	cprintf("Now tick = %d\n", get_tick());
 }
 
+int mon_cpus(int argc, char **argv)
+{
+	static const char * const status[] = {
+		[CPU_UNUSED] = "unused",
+		[CPU_STARTED] = "started",
+		[CPU_HALTED] = "halted"
+	};
+	struct CpuInfo *c;
+
+	cprintf("CPU APIC STATUS   STACK\n");
+	for (c = cpus; c < cpus + ncpu; c++)
+		cprintf("%2d%c %4d %-8s 0x%08x\n", c->cpu_id,
+			c == thiscpu ? '*' : ' ', c->cpu_apicid,
+			status[c->cpu_status], c->cpu_kstacktop);
+	return 0;
+}
+
+int mon_lockstat(int argc, char **argv)
+{
+	struct lockstat *ls;
+
+#ifndef LOCKSTAT
+	cprintf("Lock statistics are not compiled in; rebuild with 'make LOCKSTAT=1'\n");
+	return 0;
+#endif
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		lockstat_reset();
+		return 0;
+	}
+	cprintf("LOCK             ACQUIRED CONTENDED      SPINS   MAX HOLD\n");
+	for (ls = lockstat_list; ls; ls = ls->ls_next)
+		cprintf("%-16s %8u %9u %10u %10llu\n", ls->ls_name,
+			ls->ls_acquired, ls->ls_contended, ls->ls_spins,
+			ls->ls_hold_max);
+	return 0;
+}
+
 #define WHITESPACE "\t\r\n "
 #define MAXARGS 16
 
-static int runcmd(char *buf)
+// Command names that were not found, also inside time and repeat
+static int unknown_cmds;
+
+int shell_nunknown(void)
+{
+	return unknown_cmds;
+}
+
+// Lookup and invoke the command
+static int runargv(int argc, char **argv)
+{
+	int i;
+
+	if (argc == 0)
+		return 0;
+	for (i = 0; i < NCOMMANDS; i++) {
+		if (strcmp(argv[0], commands[i].name) == 0)
+			return commands[i].func(argc, argv);
+	}
+	cprintf("Unknown command '%s'\n", argv[0]);
+	unknown_cmds++;
+	return 0;
+}
+
+int runcmd(char *buf)
 {
 	int argc;
 	char *argv[MAXARGS];
-	int i;
 
 	// Parse the command buffer into whitespace-separated arguments
 	argc = 0;
@@ -71,15 +157,103 @@ static int runcmd(char *buf)
 	}
 	argv[argc] = 0;
 
-	// Lookup and invoke the command
-	if (argc == 0)
+	return runargv(argc, argv);
+}
+
+// Interrupts taken so far by all CPUs
+static uint32_t nintr(void)
+{
+	struct CpuInfo *c;
+	uint32_t n = 0;
+
+	for (c = cpus; c < cpus + ncpu; c++)
+		n += c->cpu_nintr;
+	return n;
+}
+
+int mon_time(int argc, char **argv)
+{
+	uint64_t start, cycles;
+	uint32_t intr;
+	int r;
+
+	if (argc < 2) {
+		cprintf("Usage: time <command> [args...]\n");
 		return 0;
-	for (i = 0; i < NCOMMANDS; i++) {
-		if (strcmp(argv[0], commands[i].name) == 0)
-			return commands[i].func(argc, argv);
 	}
-	cprintf("Unknown command '%s'\n", argv[0]);
-	return 0;
+	intr = nintr();
+	start = read_tsc();
+	r = runargv(argc - 1, argv + 1);
+	cycles = read_tsc() - start;
+	intr = nintr() - intr;
+	cprintf("time: %llu cycles, %llu ns, %u interrupts\n",
+		cycles, cycles_to_ns(cycles), intr);
+	return r;
+}
+
+// argv joined by spaces, for naming results
+static const char *cmdline(int argc, char **argv)
+{
+	static char buf[80];
+	int i, n = 0;
+
+	buf[0] = 0;
+	for (i = 0; i < argc && n < sizeof(buf); i++)
+		n += snprintf(buf + n, sizeof(buf) - n, i ? " %s" : "%s", argv[i]);
+	return buf;
+}
+
+// The first run is timed like the others: commands that warm up
+// caches show it as the max.
+int mon_repeat(int argc, char **argv)
+{
+	uint64_t start, t, min = ~0ULL, max = 0, sum = 0;
+	uint32_t intr;
+	int quiet = 0, was_null = 0, n, i, r = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-q") == 0) {
+		quiet = 1;
+		argc--;
+		argv++;
+	}
+	if (argc < 3 || (n = strtol(argv[1], NULL, 0)) <= 0) {
+		cprintf("Usage: repeat [-q] N <command> [args...]\n");
+		return 0;
+	}
+
+	// Show what is already in the log before dropping output
+	if (quiet) {
+		log_drain();
+		was_null = console_set_null(1);
+	}
+	intr = nintr();
+	for (i = 0; i < n && r >= 0; i++) {
+		start = read_tsc();
+		r = runargv(argc - 2, argv + 2);
+		t = read_tsc() - start;
+		if (t < min)
+			min = t;
+		if (t > max)
+			max = t;
+		sum += t;
+	}
+	intr = nintr() - intr;
+	// Restore rather than clear: an outer 'repeat -q' still wants quiet
+	if (quiet) {
+		log_drain();
+		console_set_null(was_null);
+	}
+
+	cprintf("repeat: %d runs, %u interrupts\n", i, intr);
+	cprintf("  cycles  min %llu  avg %llu  max %llu\n",
+		min, sum / i, max);
+	cprintf("  ns      min %llu  avg %llu  max %llu\n",
+		cycles_to_ns(min), cycles_to_ns(sum / i), cycles_to_ns(max));
+	benchrun_result(min, "cycles", "repeat min %s",
+			cmdline(argc - 2, argv + 2));
+	benchrun_result(sum / i, "cycles", "repeat avg %s",
+			cmdline(argc - 2, argv + 2));
+	return r;
 }
 
 int chgcolor(int argc, char **argv) {
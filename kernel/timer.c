@@ -1,12 +1,20 @@
 /* Reference: http://www.osdever.net/bkerndev/Docs/pit.htm */
 #include <kernel/trap.h>
 #include <kernel/picirq.h>
+#include <kernel/log.h>
+#include <kernel/prof.h>
 #include <inc/mmu.h>
 #include <inc/x86.h>
-
-#define TIME_HZ 100
+#include <inc/timer.h>
+#include <inc/spinlock.h>
 
 static unsigned long jiffies = 0;
+static unsigned long tsc_khz;
+
+/* The PIT interrupts tick_mult times per tick while the profiler
+*  samples faster than TIME_HZ */
+static int tick_mult = 1;
+static int tick_count;
 
 void set_timer(int hz)
 {
@@ -19,17 +27,78 @@ void set_timer(int hz)
 /* 
  * Timer interrupt handler
  */
-void timer_handler()
+void timer_handler(struct Trapframe *tf)
 {
+	extern void console_tick(void);
+
+	prof_sample(tf);
+	if (++tick_count < tick_mult)
+		return;
+	tick_count = 0;
+
 	jiffies++;
+	log_tick();
+	console_tick();
+}
+
+/* Interrupt mult times per tick, for sampling */
+void timer_set_rate(int mult)
+{
+    uint32_t eflags = irq_save();
+
+    tick_mult = mult;
+    tick_count = 0;
+    set_timer(TIME_HZ * mult);
+    irq_restore(eflags);
 }
 
 unsigned long get_tick()
 {
 	return jiffies;
 }
+
+/* Measure the TSC rate against PIT channel 2, which runs
+*  independently of the tick on channel 0 and needs no interrupts */
+static unsigned long calibrate_tsc(void)
+{
+    int latch = 1193180 / 100;        /* 10ms */
+    uint64_t start, stop;
+
+    /* Gate channel 2 on, keep the speaker off */
+    outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+    /* Channel 2, lobyte/hibyte, mode 0: OUT2 goes high at zero */
+    outb(0x43, 0xB0);
+    outb(0x42, latch & 0xFF);
+    outb(0x42, latch >> 8);
+
+    start = read_tsc();
+    while ((inb(0x61) & 0x20) == 0)
+        /* wait */;
+    stop = read_tsc();
+
+    return (uint32_t)(stop - start) / 10;
+}
+
+/* TSC cycles per millisecond */
+unsigned long get_tsc_khz()
+{
+	return tsc_khz;
+}
+
+/* TSC cycles to nanoseconds; 0 until the TSC is calibrated. Whole
+*  milliseconds and the remainder are scaled apart, so the product
+*  can't overflow however long the TSC has run */
+uint64_t cycles_to_ns(uint64_t cycles)
+{
+	if (!tsc_khz)
+		return 0;
+	return cycles / tsc_khz * 1000000 +
+	    cycles % tsc_khz * 1000000 / tsc_khz;
+}
+
 void timer_init()
 {
+	tsc_khz = calibrate_tsc();
 	set_timer(TIME_HZ);
 
 	/* Enable interrupt */
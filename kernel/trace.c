@@ -0,0 +1,105 @@
+// Binary trace buffers.  See kernel/trace.h.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <kernel/cpu.h>
+#include <kernel/log.h>
+#include <kernel/trace.h>
+
+struct TraceBuf tracebufs[NCPU];
+volatile bool trace_enabled;
+
+// Called once the BSP's %gs is set up; APs only run code that
+// traces after their own trap_init_percpu().
+void
+trace_init(void)
+{
+	trace_enabled = 1;
+}
+
+static void
+trace_clear(void)
+{
+	int i;
+
+	for (i = 0; i < ncpu; i++)
+		tracebufs[i].tb_next = 0;
+}
+
+// Format every retained record, oldest first across all CPUs.
+// Writes straight to the console, like dmesg, so a long dump doesn't
+// wash the kernel log out.
+static void
+trace_dump(void)
+{
+	uint32_t pos[NCPU], end[NCPU];
+	struct TraceRecord *tr, *first;
+	char line[160];
+	uint64_t base = 0;
+	bool was_enabled = trace_enabled;
+	int i, cpu, n;
+
+	// Stop tracing so the rings hold still while we read them
+	trace_enabled = 0;
+	log_drain();
+
+	for (i = 0; i < ncpu; i++) {
+		end[i] = tracebufs[i].tb_next;
+		pos[i] = end[i] > TRACE_SIZE ? end[i] - TRACE_SIZE : 0;
+	}
+	for (n = 0; ; n++) {
+		first = NULL;
+		cpu = 0;
+		for (i = 0; i < ncpu; i++) {
+			if (pos[i] == end[i])
+				continue;
+			tr = &tracebufs[i].tb_recs[pos[i] & (TRACE_SIZE - 1)];
+			if (!first || tr->tr_tsc < first->tr_tsc) {
+				first = tr;
+				cpu = i;
+			}
+		}
+		if (!first)
+			break;
+		pos[cpu]++;
+		if (n == 0)
+			base = first->tr_tsc;
+
+		i = snprintf(line, sizeof(line), "%d %12llu ", cpu,
+			     first->tr_tsc - base);
+		i += snprintf(line + i, sizeof(line) - i, first->tr_fmt,
+			      first->tr_args[0], first->tr_args[1],
+			      first->tr_args[2], first->tr_args[3]);
+		if (i > (int) sizeof(line) - 2)
+			i = sizeof(line) - 2;
+		if (i == 0 || line[i - 1] != '\n')
+			line[i++] = '\n';
+		console_write(line, i);
+	}
+	snprintf(line, sizeof(line), "%d records (CPU, cycles since the first)\n", n);
+	console_write(line, strlen(line));
+
+	trace_enabled = was_enabled;
+}
+
+int
+mon_trace(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "on") == 0)
+		trace_enabled = 1;
+	else if (argc > 1 && strcmp(argv[1], "off") == 0)
+		trace_enabled = 0;
+	else if (argc > 1 && strcmp(argv[1], "clear") == 0)
+		trace_clear();
+	else if (argc > 1 && strcmp(argv[1], "dump") == 0)
+		trace_dump();
+	else if (argc > 1 && strcmp(argv[1], "raw") == 0)
+		cprintf("tracebufs at 0x%08x, %d bytes per CPU, %d CPUs\n",
+			tracebufs, sizeof(tracebufs[0]), ncpu);
+	else
+		cprintf("Usage: trace on|off|clear|dump|raw (tracing is %s)\n",
+			trace_enabled ? "on" : "off");
+	return 0;
+}
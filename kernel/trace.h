@@ -0,0 +1,75 @@
+#ifndef JOS_KERN_TRACE_H
+#define JOS_KERN_TRACE_H
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <kernel/cpu.h>
+
+/*
+ * Binary tracing for hot paths.
+ *
+ *	trace("sched: stole %p from CPU %d", t, victim);
+ *
+ * records just the format pointer, the TSC and up to TRACE_NARGS
+ * argument words in the running CPU's ring; nothing is formatted until
+ * 'trace dump'.  Arguments must each fit in 32 bits (no %llx), and %s
+ * strings must still exist when the trace is dumped.  Tracing is off
+ * until trace_init() and while trace_enabled is clear.
+ *
+ * The rings are plain memory (tracebufs[], see 'trace raw'), so they
+ * can also be saved from the QEMU monitor with pmemsave and decoded on
+ * the host against the symbols and .rodata of kernel/system.
+ */
+
+#define TRACE_NARGS	4
+#define TRACE_SIZE	2048		// Records per CPU (a power of 2)
+
+struct TraceRecord {
+	uint64_t tr_tsc;
+	const char *tr_fmt;
+	uint32_t tr_args[TRACE_NARGS];
+	uint32_t tr_pad;
+};
+
+struct TraceBuf {
+	volatile uint32_t tb_next;	// Records written since trace_clear
+	uint8_t tb_pad[CACHELINE - 4];
+	struct TraceRecord tb_recs[TRACE_SIZE];
+} __attribute__((aligned(CACHELINE)));
+
+extern struct TraceBuf tracebufs[NCPU];
+extern volatile bool trace_enabled;
+
+// Only the owning CPU writes its ring, so claiming a slot needs no
+// lock prefix: a single xadd can't be split by an interrupt handler
+// that traces on the same CPU.
+static __inline void
+trace_record(const char *fmt, uint32_t a0, uint32_t a1, uint32_t a2,
+	     uint32_t a3)
+{
+	struct TraceBuf *tb;
+	struct TraceRecord *tr;
+	uint32_t idx = 1;
+
+	if (!trace_enabled)
+		return;
+	tb = &tracebufs[thiscpu->cpu_id];
+	__asm __volatile("xaddl %0, %1" : "+r" (idx), "+m" (tb->tb_next));
+	tr = &tb->tb_recs[idx & (TRACE_SIZE - 1)];
+	tr->tr_tsc = read_tsc();
+	tr->tr_fmt = fmt;
+	tr->tr_args[0] = a0;
+	tr->tr_args[1] = a1;
+	tr->tr_args[2] = a2;
+	tr->tr_args[3] = a3;
+}
+
+#define trace(...)		__trace(__VA_ARGS__, 0, 0, 0, 0)
+#define __trace(fmt, a0, a1, a2, a3, ...)				\
+	trace_record((fmt), (uint32_t) (a0), (uint32_t) (a1),		\
+		     (uint32_t) (a2), (uint32_t) (a3))
+
+void trace_init(void);
+int mon_trace(int argc, char **argv);
+
+#endif	// !JOS_KERN_TRACE_H
@@ -1,6 +1,9 @@
 #include <kernel/trap.h>
+#include <kernel/cpu.h>
 #include <inc/mmu.h>
 #include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/spinlock.h>
 
 /* For debugging, so print_trapframe can distinguish between printing
  * a saved trapframe and printing the current trapframe and print some
@@ -40,6 +43,10 @@ static const char *trapname(int trapno)
 		return excnames[trapno];
 	if (trapno == T_SYSCALL)
 		return "System call";
+	if (trapno == T_WAKEUP)
+		return "Wakeup IPI";
+	if (trapno == T_BENCH)
+		return "Benchmark";
 	if (trapno >= IRQ_OFFSET && trapno < IRQ_OFFSET + 16)
 		return "Hardware Interrupt";
 	return "(unknown trap)";
@@ -96,17 +103,30 @@ print_regs(struct PushRegs *regs)
 static void
 trap_dispatch(struct Trapframe *tf)
 {
-    extern void timer_handler();
+    extern void timer_handler(struct Trapframe *tf);
 	extern void kbd_intr();
+	extern void serial_intr();
 
   	switch (tf->tf_trapno) {
 		case IRQ_OFFSET + IRQ_TIMER:
-			timer_handler();
+			timer_handler(tf);
 			break;
 
 		case IRQ_OFFSET + IRQ_KBD:
 			kbd_intr();
 			break;
+
+		case IRQ_OFFSET + IRQ_SERIAL:
+			serial_intr();
+			break;
+
+		case T_WAKEUP:
+			// Nothing to do: the halted CPU resumes its idle loop.
+			lapic_eoi();
+			break;
+
+		case T_BENCH:
+			break;
 	  
 		default:
 		  	// Unexpected trap: The user process or the kernel has a bug.
@@ -124,9 +144,18 @@ void default_trap_handler(struct Trapframe *tf)
 	// Record that tf is the last real trapframe so
 	// print_trapframe can print some additional information.
 	last_tf = tf;
+	thiscpu->cpu_nintr++;
+
+	// Interrupt gates clear IF, so from the interrupted instruction
+	// to the iret is an interrupts-off section
+	if (tf->tf_eflags & FL_IF)
+		irqsoff_begin(tf->tf_eip);
 
 	// Dispatch based on what type of trap occurred
 	trap_dispatch(tf);
+
+	if (tf->tf_eflags & FL_IF)
+		irqsoff_end(0);
 }
 
 
@@ -134,11 +163,73 @@ void trap_init()
 {
 	extern void isr_kbd();
 	extern void isr_timer();
+	extern void isr_serial();
+	extern void isr_wakeup();
+	extern void isr_bench();
 
 	SETGATE(idt[IRQ_OFFSET + IRQ_KBD], 0, GD_KT, isr_kbd, 0);
 	SETGATE(idt[IRQ_OFFSET + IRQ_TIMER], 0, GD_KT, isr_timer, 0);
+	SETGATE(idt[IRQ_OFFSET + IRQ_SERIAL], 0, GD_KT, isr_serial, 0);
+	SETGATE(idt[T_WAKEUP], 0, GD_KT, isr_wakeup, 0);
+	SETGATE(idt[T_BENCH], 0, GD_KT, isr_bench, 0);
 
-	idt_pd.pd_base = idt;
+	idt_pd.pd_base = (uint32_t) idt;
 	idt_pd.pd_lim = sizeof(idt) - 1;
+
+	// Per-CPU setup
+	trap_init_percpu();
+}
+
+/*
+ * Initialize and load the running CPU's GDT, TSS, IDT and %gs.
+ * Every CPU gets a private GDT so that its TSS can sit at GD_TSS0
+ * and GD_PERCPU can point at its own struct CpuInfo.
+ */
+void
+trap_init_percpu(void)
+{
+	extern char bootstacktop[];
+	struct CpuInfo *c = &cpus[cpunum()];
+	struct Segdesc *gdt = c->cpu_gdt;
+
+	c->cpu_self = c;
+	if (c == bootcpu)
+		c->cpu_kstacktop = (uintptr_t) bootstacktop;
+	else
+		c->cpu_kstacktop = (uintptr_t) percpu_kstacks[c->cpu_id] + KSTKSIZE;
+
+	gdt[0] = SEG_NULL;
+	gdt[GD_KT >> 3] = SEG(STA_X | STA_R, 0x0, 0xffffffff, 0);
+	gdt[GD_KD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 0);
+	gdt[GD_UT >> 3] = SEG(STA_X | STA_R, 0x0, 0xffffffff, 3);
+	gdt[GD_UD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 3);
+	gdt[GD_TSS0 >> 3] = SEG16(STS_T32A, (uint32_t) (&c->cpu_ts),
+				  sizeof(struct Taskstate) - 1, 0);
+	gdt[GD_TSS0 >> 3].sd_s = 0;
+	gdt[GD_PERCPU >> 3] = SEG(STA_W, (uint32_t) c, 0xffffffff, 0);
+
+	c->cpu_gdt_pd.pd_lim = sizeof(c->cpu_gdt) - 1;
+	c->cpu_gdt_pd.pd_base = (uint32_t) gdt;
+	lgdt(&c->cpu_gdt_pd);
+
+	// Reload all segment registers from the new GDT.
+	// %fs is spare; %gs addresses this CPU's CpuInfo.
+	__asm __volatile("movw %%ax,%%gs" : : "a" (GD_PERCPU));
+	__asm __volatile("movw %%ax,%%fs" : : "a" (GD_KD));
+	__asm __volatile("movw %%ax,%%es" : : "a" (GD_KD));
+	__asm __volatile("movw %%ax,%%ds" : : "a" (GD_KD));
+	__asm __volatile("movw %%ax,%%ss" : : "a" (GD_KD));
+	// Reload cs with a far jump
+	__asm __volatile("ljmp %0,$1f\n 1:\n" : : "i" (GD_KT));
+	lldt(0);
+
+	// Setup a TSS so that we get the right stack
+	// when we trap to the kernel.
+	c->cpu_ts.ts_esp0 = c->cpu_kstacktop;
+	c->cpu_ts.ts_ss0 = GD_KD;
+	c->cpu_ts.ts_iomb = sizeof(struct Taskstate);
+	ltr(GD_TSS0);
+
+	// All CPUs share the one IDT
 	lidt(&idt_pd);
 }
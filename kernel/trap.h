@@ -11,7 +11,7 @@ extern struct Gatedesc idt[];
 extern struct Pseudodesc idt_pd;
 
 void trap_init(void);
-//void trap_init_percpu(void);
+void trap_init_percpu(void);
 void print_regs(struct PushRegs *regs);
 void print_trapframe(struct Trapframe *tf);
 //void page_fault_handler(struct Trapframe *);
@@ -30,25 +30,114 @@ static const char * const error_string[MAXERROR] =
 	[E_EOF]		= "unexpected end of file",
 };
 
+static const char digits[] = "0123456789abcdef";
+
+// "00" "01" ... "99": decimal digits are produced two at a time.
+static const char digit_pairs[200] =
+	"00010203040506070809101112131415161718192021222324"
+	"25262728293031323334353637383940414243444546474849"
+	"50515253545556575859606162636465666768697071727374"
+	"75767778798081828384858687888990919293949596979899";
+
+// Emit n copies of padc, a chunk at a time.
+static void
+printpad(const struct printsink *sink, int padc, int n)
+{
+	char pad[16];
+	int i;
+
+	if (n <= 0)
+		return;
+	for (i = 0; i < sizeof(pad) && i < n; i++)
+		pad[i] = padc;
+	for (; n > sizeof(pad); n -= sizeof(pad))
+		sink->write(pad, sizeof(pad), sink->putdat);
+	sink->write(pad, n, sink->putdat);
+}
+
+// Divide *n by base in place and return the remainder, using two
+// 32-bit divl instead of a libgcc __udivdi3/__umoddi3 pair.
+static uint32_t
+div64_32(unsigned long long *n, uint32_t base)
+{
+	uint32_t hi = *n >> 32, lo = *n, rem;
+	uint32_t qhi = hi / base;
+
+	hi %= base;
+	// hi < base now, so the quotient fits in 32 bits
+	__asm("divl %4" : "=a" (lo), "=d" (rem) : "0" (lo), "1" (hi), "rm" (base));
+	*n = ((unsigned long long) qhi << 32) | lo;
+	return rem;
+}
+
+// Write the decimal digits of num backwards, ending just before end.
+// Stops after ndigits digits if ndigits > 0 (padding with zeros).
+// Returns the first digit.
+static char *
+fmt_dec32(char *end, uint32_t num, int ndigits)
+{
+	char *p = end;
+	uint32_t r;
+
+	while (num >= 100) {
+		r = num % 100;
+		num /= 100;
+		p -= 2;
+		p[0] = digit_pairs[2 * r];
+		p[1] = digit_pairs[2 * r + 1];
+	}
+	if (num >= 10) {
+		p -= 2;
+		p[0] = digit_pairs[2 * num];
+		p[1] = digit_pairs[2 * num + 1];
+	} else
+		*--p = '0' + num;
+	while (end - p < ndigits)
+		*--p = '0';
+	return p;
+}
+
 /*
- * Print a number (base <= 16) in reverse order,
- * using specified putch function and associated pointer putdat.
+ * Print a number (base <= 16) to the sink, padded on the left to
+ * width with padc.  The digits are formatted into a local buffer from
+ * the right, so there is no recursion, and 64-bit arithmetic is only
+ * used while the value doesn't fit in 32 bits.
  */
 static void
-printnum(void (*putch)(int, void*), void *putdat,
+printnum(const struct printsink *sink,
 	 unsigned long long num, unsigned base, int width, int padc)
 {
-	// first recursively print all preceding (more significant) digits
-	if (num >= base) {
-		printnum(putch, putdat, num / base, base, width - 1, padc);
+	char buf[24];		// 2^64 - 1 has 22 octal digits
+	char *end = buf + sizeof(buf), *p = end;
+	unsigned shift;
+	uint32_t lo;
+
+	if (base == 16 || base == 8) {
+		// Powers of two: shift and mask
+		shift = (base == 16) ? 4 : 3;
+		do {
+			*--p = digits[num & (base - 1)];
+			num >>= shift;
+		} while (num);
+	} else if (base == 10) {
+		// Peel off nine digits at a time until the rest fits
+		// in 32 bits
+		while (num >> 32)
+			p = fmt_dec32(p, div64_32(&num, 1000000000), 9);
+		p = fmt_dec32(p, num, 0);
 	} else {
-		// print any needed pad characters before first digit
-		while (--width > 0)
-			putch(padc, putdat);
+		while (num >> 32)
+			*--p = digits[div64_32(&num, base)];
+		lo = num;
+		do {
+			*--p = digits[lo % base];
+			lo /= base;
+		} while (lo);
 	}
 
-	// then print this (the least significant) digit
-	putch("0123456789abcdef"[num % base], putdat);
+	// print any needed pad characters before first digit
+	printpad(sink, padc, width - (end - p));
+	sink->write(p, end - p, sink->putdat);
 }
 
 // Get an unsigned int of various possible sizes from a varargs list,
@@ -79,23 +168,24 @@ getint(va_list *ap, int lflag)
 
 
 // Main function to format and print a string.
-void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
-
+// Runs of literal text and each formatted field reach the sink in
+// one write() call rather than a call per byte.
 void
-vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+vprintfmt_sink(const struct printsink *sink, const char *fmt, va_list ap)
 {
 	register const char *p;
 	register int ch, err;
 	unsigned long long num;
-	int base, lflag, width, precision, altflag;
-	char padc;
+	int base, lflag, width, precision, altflag, len;
+	char padc, c;
 
 	while (1) {
-		while ((ch = *(unsigned char *) fmt++) != '%') {
-			if (ch == '\0')
-				return;
-			putch(ch, putdat);
-		}
+		for (p = fmt; *fmt != '%' && *fmt != '\0'; fmt++)
+			/* find the end of the literal run */;
+		if (fmt > p)
+			sink->write(p, fmt - p, sink->putdat);
+		if (*fmt++ == '\0')
+			return;
 
 		// Process a %-escape sequence
 		padc = ' ';
@@ -159,7 +249,8 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 
 		// character
 		case 'c':
-			putch(va_arg(ap, int), putdat);
+			c = va_arg(ap, int);
+			sink->write(&c, 1, sink->putdat);
 			break;
 
 		// error message
@@ -167,33 +258,46 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			err = va_arg(ap, int);
 			if (err < 0)
 				err = -err;
-			if (err >= MAXERROR || (p = error_string[err]) == NULL)
-				printfmt(putch, putdat, "error %d", err);
-			else
-				printfmt(putch, putdat, "%s", p);
+			if (err >= MAXERROR || (p = error_string[err]) == NULL) {
+				sink->write("error ", 6, sink->putdat);
+				num = err;
+				width = -1;
+				base = 10;
+				goto number;
+			}
+			sink->write(p, strlen(p), sink->putdat);
 			break;
 
 		// string
 		case 's':
 			if ((p = va_arg(ap, char *)) == NULL)
 				p = "(null)";
-			if (width > 0 && padc != '-')
-				for (width -= strnlen(p, precision); width > 0; width--)
-					putch(padc, putdat);
-			for (; (ch = *p++) != '\0' && (precision < 0 || --precision >= 0); width--)
-				if (altflag && (ch < ' ' || ch > '~'))
-					putch('?', putdat);
-				else
-					putch(ch, putdat);
-			for (; width > 0; width--)
-				putch(' ', putdat);
+			len = strnlen(p, precision);
+			if (padc != '-')
+				printpad(sink, padc, width - len);
+			if (altflag) {
+				// Replace unprintable characters with '?'
+				char buf[64];
+				int i, n;
+
+				for (i = 0; i < len; i += n) {
+					for (n = 0; n < sizeof(buf) && i + n < len; n++) {
+						ch = p[i + n];
+						buf[n] = (ch < ' ' || ch > '~') ? '?' : ch;
+					}
+					sink->write(buf, n, sink->putdat);
+				}
+			} else
+				sink->write(p, len, sink->putdat);
+			if (padc == '-')
+				printpad(sink, ' ', width - len);
 			break;
 
 		// (signed) decimal
 		case 'd':
 			num = getint(&ap, lflag);
 			if ((long long) num < 0) {
-				putch('-', putdat);
+				sink->write("-", 1, sink->putdat);
 				num = -(long long) num;
 			}
 			base = 10;
@@ -208,15 +312,12 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 		// (unsigned) octal
 		case 'o':
 			// Replace this with your code.
-			putch('X', putdat);
-			putch('X', putdat);
-			putch('X', putdat);
+			sink->write("XXX", 3, sink->putdat);
 			break;
 
 		// pointer
 		case 'p':
-			putch('0', putdat);
-			putch('x', putdat);
+			sink->write("0x", 2, sink->putdat);
 			num = (unsigned long long)
 				(uintptr_t) va_arg(ap, void *);
 			base = 16;
@@ -227,17 +328,17 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			num = getuint(&ap, lflag);
 			base = 16;
 		number:
-			printnum(putch, putdat, num, base, width, padc);
+			printnum(sink, num, base, width, padc);
 			break;
 
 		// escaped '%' character
 		case '%':
-			putch(ch, putdat);
+			sink->write("%", 1, sink->putdat);
 			break;
 
 		// unrecognized escape sequence - just print it literally
 		default:
-			putch('%', putdat);
+			sink->write("%", 1, sink->putdat);
 			for (fmt--; fmt[-1] != '%'; fmt--)
 				/* do nothing */;
 			break;
@@ -245,6 +346,28 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 	}
 }
 
+// Adapts a per-character putch callback to the sink interface.
+struct putchsink {
+	void (*putch)(int, void*);
+	void *putdat;
+};
+
+static void
+putch_write(const char *buf, int len, struct putchsink *ps)
+{
+	while (len-- > 0)
+		ps->putch(*buf++, ps->putdat);
+}
+
+void
+vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+{
+	struct putchsink ps = { putch, putdat };
+	struct printsink sink = { (void *) putch_write, &ps };
+
+	vprintfmt_sink(&sink, fmt, ap);
+}
+
 void
 printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...)
 {
@@ -262,23 +385,26 @@ struct sprintbuf {
 };
 
 static void
-sprintputch(int ch, struct sprintbuf *b)
+sprintwrite(const char *s, int len, struct sprintbuf *b)
 {
-	b->cnt++;
-	if (b->buf < b->ebuf)
-		*b->buf++ = ch;
+	int n = MIN(len, b->ebuf - b->buf);
+
+	b->cnt += len;
+	memcpy(b->buf, s, n);
+	b->buf += n;
 }
 
 int
 vsnprintf(char *buf, int n, const char *fmt, va_list ap)
 {
 	struct sprintbuf b = {buf, buf+n-1, 0};
+	struct printsink sink = { (void *) sprintwrite, &b };
 
 	if (buf == NULL || n < 1)
 		return -E_INVAL;
 
 	// print the string to the buffer
-	vprintfmt((void*)sprintputch, &b, fmt, ap);
+	vprintfmt_sink(&sink, fmt, ap);
 
 	// null terminate the buffer
 	*b.buf = '\0';
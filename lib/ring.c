@@ -0,0 +1,100 @@
+// Single-producer/single-consumer lock-free byte ring.
+// See inc/ring.h.
+
+#include <inc/types.h>
+#include <inc/string.h>
+#include <inc/ring.h>
+
+// x86 keeps loads ordered with loads and stores ordered with stores,
+// and never moves a store before an earlier load.  So acquire and
+// release need nothing more than stopping the compiler from
+// reordering around the access.
+#define load_acquire(p)							\
+({									\
+	typeof(*(p)) __v = *(p);					\
+	__asm __volatile("" ::: "memory");				\
+	__v;								\
+})
+#define store_release(p, v)						\
+do {									\
+	__asm __volatile("" ::: "memory");				\
+	*(p) = (v);							\
+} while (0)
+
+// size must be a power of 2.
+void
+ring_init(struct ring *r, void *buf, uint32_t size)
+{
+	r->r_buf = buf;
+	r->r_mask = size - 1;
+	r->r_head = r->r_tail = 0;
+	r->r_overflow = 0;
+}
+
+// Producer: append c.  Returns 0, or -1 if the ring is full.
+int
+ring_put(struct ring *r, uint8_t c)
+{
+	uint32_t head = r->r_head;
+
+	if (head - load_acquire(&r->r_tail) > r->r_mask) {
+		r->r_overflow++;
+		return -1;
+	}
+	r->r_buf[head & r->r_mask] = c;
+	store_release(&r->r_head, head + 1);
+	return 0;
+}
+
+// Producer: append as much of buf as fits.  Returns the number of
+// bytes written; the rest are dropped and counted as overflow.
+uint32_t
+ring_write(struct ring *r, const void *buf, uint32_t len)
+{
+	uint32_t head = r->r_head;
+	uint32_t space = r->r_mask + 1 - (head - load_acquire(&r->r_tail));
+	uint32_t off = head & r->r_mask;
+	uint32_t first;
+
+	if (len > space) {
+		r->r_overflow += len - space;
+		len = space;
+	}
+	// Copy in at most two pieces: up to the end, then from the start.
+	first = MIN(len, r->r_mask + 1 - off);
+	memcpy(r->r_buf + off, buf, first);
+	memcpy(r->r_buf, (const uint8_t *) buf + first, len - first);
+	store_release(&r->r_head, head + len);
+	return len;
+}
+
+// Consumer: remove and return the oldest byte, or -1 if empty.
+int
+ring_get(struct ring *r)
+{
+	uint32_t tail = r->r_tail;
+	int c;
+
+	if (load_acquire(&r->r_head) == tail)
+		return -1;
+	c = r->r_buf[tail & r->r_mask];
+	store_release(&r->r_tail, tail + 1);
+	return c;
+}
+
+// Consumer: remove up to len bytes into buf.  Returns the number read.
+uint32_t
+ring_read(struct ring *r, void *buf, uint32_t len)
+{
+	uint32_t tail = r->r_tail;
+	uint32_t avail = load_acquire(&r->r_head) - tail;
+	uint32_t off = tail & r->r_mask;
+	uint32_t first;
+
+	len = MIN(len, avail);
+	first = MIN(len, r->r_mask + 1 - off);
+	memcpy(buf, r->r_buf + off, first);
+	memcpy((uint8_t *) buf + first, r->r_buf, len - first);
+	store_release(&r->r_tail, tail + len);
+	return len;
+}
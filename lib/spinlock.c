@@ -0,0 +1,188 @@
+// Spinlock, ticket lock and MCS lock primitives.
+// See inc/spinlock.h for when to use which.
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/spinlock.h>
+
+struct lockstat *lockstat_list;
+
+#ifdef LOCKSTAT
+// Called with the lock held, so only one CPU registers a given lock.
+static void
+lockstat_acquired(struct lockstat *ls, uint32_t spins)
+{
+	struct lockstat *head;
+
+	if (!ls->ls_registered) {
+		ls->ls_registered = 1;
+		do {
+			head = lockstat_list;
+			ls->ls_next = head;
+		} while (cmpxchg((volatile uint32_t *) &lockstat_list,
+				 (uint32_t) head, (uint32_t) ls) != (uint32_t) head);
+	}
+	ls->ls_acquired++;
+	if (spins) {
+		ls->ls_contended++;
+		ls->ls_spins += spins;
+	}
+	ls->ls_hold_start = read_tsc();
+}
+
+static void
+lockstat_released(struct lockstat *ls)
+{
+	uint64_t held = read_tsc() - ls->ls_hold_start;
+
+	if (held > ls->ls_hold_max)
+		ls->ls_hold_max = held;
+}
+
+static void
+lockstat_init(struct lockstat *ls, const char *name)
+{
+	ls->ls_name = name;
+}
+
+#define ACQUIRED(lk, spins)	lockstat_acquired(&(lk)->stat, (spins))
+#define RELEASED(lk)		lockstat_released(&(lk)->stat)
+#define INITSTAT(lk, name)	lockstat_init(&(lk)->stat, (name))
+#else
+#define ACQUIRED(lk, spins)	((void) (spins))
+#define RELEASED(lk)		do { } while (0)
+#define INITSTAT(lk, name)	do { } while (0)
+#endif
+
+// Zero the counters of every registered lock.
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+
+	for (ls = lockstat_list; ls; ls = ls->ls_next) {
+		ls->ls_acquired = ls->ls_contended = ls->ls_spins = 0;
+		ls->ls_hold_max = 0;
+	}
+}
+
+/***** Test-and-test-and-set spinlock *****/
+
+void
+spin_initlock(struct spinlock *lk, const char *name)
+{
+	lk->locked = 0;
+	INITSTAT(lk, name);
+}
+
+void
+spin_lock(struct spinlock *lk)
+{
+	uint32_t spins = 0;
+
+	// Only retry the atomic xchg once the lock looks free, so
+	// waiters spin in their own cache instead of on the bus.
+	while (xchg(&lk->locked, 1) != 0)
+		while (lk->locked) {
+			pause();
+			spins++;
+		}
+	ACQUIRED(lk, spins);
+}
+
+// Returns 1 if the lock was taken, 0 if it is held by someone else.
+int
+spin_trylock(struct spinlock *lk)
+{
+	if (lk->locked || xchg(&lk->locked, 1) != 0)
+		return 0;
+	ACQUIRED(lk, 0);
+	return 1;
+}
+
+void
+spin_unlock(struct spinlock *lk)
+{
+	RELEASED(lk);
+	// Stores are not reordered with earlier loads or stores,
+	// so a plain store releases the lock.
+	__asm __volatile("" ::: "memory");
+	lk->locked = 0;
+}
+
+/***** Ticket lock *****/
+
+void
+ticket_initlock(struct ticketlock *lk, const char *name)
+{
+	lk->next = lk->owner = 0;
+	INITSTAT(lk, name);
+}
+
+void
+ticket_lock(struct ticketlock *lk)
+{
+	uint32_t me = xadd(&lk->next, 1);
+	uint32_t spins = 0;
+
+	while (lk->owner != me) {
+		pause();
+		spins++;
+	}
+	ACQUIRED(lk, spins);
+}
+
+void
+ticket_unlock(struct ticketlock *lk)
+{
+	RELEASED(lk);
+	__asm __volatile("" ::: "memory");
+	// Only the holder writes owner, so no atomic is needed.
+	lk->owner = lk->owner + 1;
+}
+
+/***** MCS queue lock *****/
+
+void
+mcs_initlock(struct mcslock *lk, const char *name)
+{
+	lk->tail = NULL;
+	INITSTAT(lk, name);
+}
+
+// me must stay valid (e.g. on the caller's stack) until mcs_unlock.
+void
+mcs_lock(struct mcslock *lk, struct mcs_node *me)
+{
+	struct mcs_node *prev;
+	uint32_t spins = 0;
+
+	me->next = NULL;
+	me->locked = 1;
+	prev = (struct mcs_node *) xchg((volatile uint32_t *) &lk->tail,
+					(uint32_t) me);
+	if (prev) {
+		prev->next = me;
+		while (me->locked) {
+			pause();
+			spins++;
+		}
+	}
+	ACQUIRED(lk, spins);
+}
+
+void
+mcs_unlock(struct mcslock *lk, struct mcs_node *me)
+{
+	RELEASED(lk);
+	if (me->next == NULL) {
+		// No known successor: try to swing tail back to empty.
+		if (cmpxchg((volatile uint32_t *) &lk->tail,
+			    (uint32_t) me, 0) == (uint32_t) me)
+			return;
+		// A new waiter swapped itself in; wait for it to link up.
+		while (me->next == NULL)
+			pause();
+	}
+	me->next->locked = 0;
+}
@@ -4,6 +4,9 @@
 // Basic string routines.  Not hardware optimized, but not shabby.
 
 #include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/spinlock.h>
 
 // Using assembly for memset/memmove
 // makes some difference on real hardware,
@@ -11,14 +14,31 @@
 // Primespipe runs 3x faster this way.
 #define ASM 1
 
+// The scanning routines below work a 32-bit word at a time once the
+// pointer is aligned.  A word w contains a zero byte exactly when
+// haszero(w) is non-zero; XOR with a repeated byte first to look for
+// that byte instead.  Aligned loads never straddle a page, so reading
+// the rest of the word that holds the terminator can't fault.
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+#define ONES		0x01010101
+#define HIGHS		0x80808080
+#define haszero(w)	(((w) - ONES) & ~(w) & HIGHS)
+
 int
 strlen(const char *s)
 {
-	int n;
+	const char *p = s;
+	const word_t *w;
 
-	for (n = 0; *s != '\0'; s++)
-		n++;
-	return n;
+	for (; (uintptr_t) p & 3; p++)
+		if (*p == '\0')
+			return p - s;
+	for (w = (const word_t *) p; !haszero(*w); w++)
+		/* do nothing */;
+	for (p = (const char *) w; *p != '\0'; p++)
+		/* do nothing */;
+	return p - s;
 }
 
 int
@@ -82,8 +102,25 @@ strlcpy(char *dst, const char *src, size_t size)
 int
 strcmp(const char *p, const char *q)
 {
+	const word_t *wp, *wq;
+
+	// With the same alignment, compare a word at a time until the
+	// words differ or hold the terminator.  Otherwise one of the
+	// loads would be unaligned and could cross into the next page.
+	if ((((uintptr_t) p ^ (uintptr_t) q) & 3) == 0) {
+		for (; (uintptr_t) p & 3; p++, q++)
+			if (*p == '\0' || *p != *q)
+				goto out;
+		wp = (const word_t *) p;
+		wq = (const word_t *) q;
+		while (*wp == *wq && !haszero(*wp))
+			wp++, wq++;
+		p = (const char *) wp;
+		q = (const char *) wq;
+	}
 	while (*p && *p == *q)
 		p++, q++;
+out:
 	return (int) ((unsigned char) *p - (unsigned char) *q);
 }
 
@@ -103,10 +140,21 @@ strncmp(const char *p, const char *q, size_t n)
 char *
 strchr(const char *s, char c)
 {
-	for (; *s; s++)
+	uint32_t pat = (uint8_t) c * ONES;
+	const word_t *w;
+
+	for (; (uintptr_t) s & 3; s++) {
+		if (*s == '\0')
+			return NULL;
 		if (*s == c)
 			return (char *) s;
-	return 0;
+	}
+	for (w = (const word_t *) s; !haszero(*w) && !haszero(*w ^ pat); w++)
+		/* do nothing */;
+	for (s = (const char *) w; *s; s++)
+		if (*s == c)
+			return (char *) s;
+	return NULL;
 }
 
 // Return a pointer to the first occurrence of 'c' in 's',
@@ -121,23 +169,196 @@ strfind(const char *s, char c)
 }
 
 #if ASM
+/*
+ * memset and memmove pick their bulk routine at boot (string_init)
+ * from what CPUID reports:
+ *
+ *  - Any CPU: bytes up to a 4-byte aligned destination, rep movsl or
+ *    rep stosl for the words, then the remaining bytes.
+ *  - ERMS (enhanced rep movsb/stosb): a single rep movsb or stosb,
+ *    which the microcode already runs in wide chunks whatever the
+ *    alignment or length.
+ *  - SSE2, for NT_THRESHOLD bytes or more: 64 bytes per iteration
+ *    with non-temporal stores.  They bypass the cache, so a copy much
+ *    larger than the cache doesn't evict everything else.
+ *
+ * Nothing saves the XMM registers on an interrupt, so the SSE2 loops
+ * run with interrupts off.  The kernel is built without SSE code
+ * generation, so no other code keeps values in them (and GCC won't
+ * accept them as clobbers).
+ *
+ * The host-side tests (test/) call string_init at CPL 3, where the
+ * OS has already enabled SSE and saves XMM state for us, and where
+ * touching CR0/CR4 or IF would fault.
+ */
+#define NT_THRESHOLD	(256 * 1024)
+
+static void copy_movsl(char *d, const char *s, size_t n);
+static void fill_stosl(char *d, int c, size_t n);
+
+static void (*copy_fwd)(char *d, const char *s, size_t n) = copy_movsl;
+static void (*fill)(char *d, int c, size_t n) = fill_stosl;
+// These two are in .data rather than .bss: kernel_main() clears the
+// .bss with memset() before string_init(), and the boot loader leaves
+// the .bss holding whatever was in RAM, so a stale has_sse2 would
+// send that clear into fill_sse2() before SSE is enabled.
+static bool has_sse2 __attribute__((section(".data")));
+// Running at CPL 0: manage CR4 and IF
+static bool kernel_mode __attribute__((section(".data")));
+
+static void
+copy_movsb(char *d, const char *s, size_t n)
+{
+	asm volatile("cld; rep movsb"
+		: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+}
+
+static void
+copy_movsl(char *d, const char *s, size_t n)
+{
+	size_t head, words;
+
+	if (n >= 16) {
+		head = -(uintptr_t) d & 3;
+		words = (n - head) / 4;
+		n = (n - head) & 3;
+		asm volatile("cld; rep movsb; movl %3, %%ecx; rep movsl"
+			: "+D" (d), "+S" (s), "+c" (head)
+			: "r" (words) : "cc", "memory");
+	}
+	asm volatile("cld; rep movsb"
+		: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+}
+
+static void
+copy_sse2(char *d, const char *s, size_t n)
+{
+	size_t head = -(uintptr_t) d & 15;
+	size_t blocks;
+	uint32_t eflags = 0;
+
+	copy_fwd(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+	blocks = n / 64;
+
+	if (kernel_mode)
+		eflags = irq_save();
+	asm volatile("1:\tprefetchnta 256(%%esi)\n\t"
+		"movdqu (%%esi), %%xmm0\n\t"
+		"movdqu 16(%%esi), %%xmm1\n\t"
+		"movdqu 32(%%esi), %%xmm2\n\t"
+		"movdqu 48(%%esi), %%xmm3\n\t"
+		"movntdq %%xmm0, (%%edi)\n\t"
+		"movntdq %%xmm1, 16(%%edi)\n\t"
+		"movntdq %%xmm2, 32(%%edi)\n\t"
+		"movntdq %%xmm3, 48(%%edi)\n\t"
+		"addl $64, %%esi\n\t"
+		"addl $64, %%edi\n\t"
+		"decl %%ecx\n\t"
+		"jnz 1b\n\t"
+		"sfence"
+		: "+D" (d), "+S" (s), "+c" (blocks)
+		: : "cc", "memory");
+	if (kernel_mode)
+		irq_restore(eflags);
+
+	copy_fwd(d, s, n & 63);
+}
+
+static void
+fill_stosb(char *d, int c, size_t n)
+{
+	asm volatile("cld; rep stosb"
+		: "+D" (d), "+c" (n) : "a" (c) : "cc", "memory");
+}
+
+static void
+fill_stosl(char *d, int c, size_t n)
+{
+	size_t head, words;
+
+	c = (c & 0xFF) * 0x01010101;
+	if (n >= 16) {
+		head = -(uintptr_t) d & 3;
+		words = (n - head) / 4;
+		n = (n - head) & 3;
+		asm volatile("cld; rep stosb; movl %2, %%ecx; rep stosl"
+			: "+D" (d), "+c" (head)
+			: "r" (words), "a" (c) : "cc", "memory");
+	}
+	asm volatile("cld; rep stosb"
+		: "+D" (d), "+c" (n) : "a" (c) : "cc", "memory");
+}
+
+static void
+fill_sse2(char *d, int c, size_t n)
+{
+	size_t head = -(uintptr_t) d & 15;
+	size_t blocks;
+	uint32_t eflags = 0;
+
+	fill(d, c, head);
+	d += head;
+	n -= head;
+	blocks = n / 64;
+
+	if (kernel_mode)
+		eflags = irq_save();
+	asm volatile("movd %2, %%xmm0\n\t"
+		"pshufd $0, %%xmm0, %%xmm0\n"
+		"1:\tmovntdq %%xmm0, (%%edi)\n\t"
+		"movntdq %%xmm0, 16(%%edi)\n\t"
+		"movntdq %%xmm0, 32(%%edi)\n\t"
+		"movntdq %%xmm0, 48(%%edi)\n\t"
+		"addl $64, %%edi\n\t"
+		"decl %%ecx\n\t"
+		"jnz 1b\n\t"
+		"sfence"
+		: "+D" (d), "+c" (blocks)
+		: "r" ((c & 0xFF) * 0x01010101)
+		: "cc", "memory");
+	if (kernel_mode)
+		irq_restore(eflags);
+
+	fill(d, c, n & 63);
+}
+
+// Pick the memset/memmove routines and, if SSE2 is there, let this
+// CPU use it.  Called on every CPU during boot.
+void
+string_init(void)
+{
+	uint32_t maxleaf, ebx = 0, edx;
+	uint16_t cs;
+
+	asm volatile("movw %%cs, %0" : "=r" (cs));
+	kernel_mode = (cs & 3) == 0;
+	cpuid(0, &maxleaf, NULL, NULL, NULL);
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (maxleaf >= 7)
+		asm volatile("cpuid" : "=b" (ebx)
+			: "a" (7), "c" (0) : "edx");
+
+	if (ebx & CPUID_7_EBX_ERMS) {
+		copy_fwd = copy_movsb;
+		fill = fill_stosb;
+	}
+	if ((edx & CPUID_1_EDX_SSE2) && kernel_mode) {
+		lcr0((rcr0() & ~(CR0_EM | CR0_TS)) | CR0_MP);
+		lcr4(rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	}
+	has_sse2 = (edx & CPUID_1_EDX_SSE2) != 0;
+}
+
 void *
 memset(void *v, int c, size_t n)
 {
-	char *p;
-
-	if (n == 0)
-		return v;
-	if ((int)v%4 == 0 && n%4 == 0) {
-		c &= 0xFF;
-		c = (c<<24)|(c<<16)|(c<<8)|c;
-		asm volatile("cld; rep stosl\n"
-			:: "D" (v), "a" (c), "c" (n/4)
-			: "cc", "memory");
-	} else
-		asm volatile("cld; rep stosb\n"
-			:: "D" (v), "a" (c), "c" (n)
-			: "cc", "memory");
+	if (n >= NT_THRESHOLD && has_sse2)
+		fill_sse2(v, c, n);
+	else
+		fill(v, c, n);
 	return v;
 }
 
@@ -146,33 +367,40 @@ memmove(void *dst, const void *src, size_t n)
 {
 	const char *s;
 	char *d;
+	size_t tail, words;
 
 	s = src;
 	d = dst;
 	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("std; rep movsl\n"
-				:: "D" (d-4), "S" (s-4), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("std; rep movsb\n"
-				:: "D" (d-1), "S" (s-1), "c" (n) : "cc", "memory");
-		// Some versions of GCC rely on DF being clear
-		asm volatile("cld" ::: "cc");
-	} else {
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("cld; rep movsl\n"
-				:: "D" (d), "S" (s), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("cld; rep movsb\n"
-				:: "D" (d), "S" (s), "c" (n) : "cc", "memory");
-	}
+		// Copy backwards from the last byte: the odd bytes at
+		// the end first, then whole words.  Some versions of
+		// GCC rely on DF being clear, so clear it again.
+		s += n - 1;
+		d += n - 1;
+		tail = n & 3;
+		words = n / 4;
+		asm volatile("std; rep movsb\n\t"
+			"subl $3, %%esi\n\t"
+			"subl $3, %%edi\n\t"
+			"movl %3, %%ecx\n\t"
+			"rep movsl\n\t"
+			"cld"
+			: "+D" (d), "+S" (s), "+c" (tail)
+			: "r" (words) : "cc", "memory");
+	} else if (n >= NT_THRESHOLD && has_sse2)
+		copy_sse2(d, s, n);
+	else
+		copy_fwd(d, s, n);
 	return dst;
 }
 
 #else
 
+void
+string_init(void)
+{
+}
+
 void *
 memset(void *v, int c, size_t n)
 {
@@ -220,6 +448,10 @@ memcmp(const void *v1, const void *v2, size_t n)
 	const uint8_t *s1 = (const uint8_t *) v1;
 	const uint8_t *s2 = (const uint8_t *) v2;
 
+	// Skip equal words; x86 allows the unaligned loads, and they
+	// stay within the n bytes.  The bytes decide the rest.
+	for (; n >= 4 && *(const word_t *) s1 == *(const word_t *) s2; n -= 4)
+		s1 += 4, s2 += 4;
 	while (n-- > 0) {
 		if (*s1 != *s2)
 			return (int) *s1 - (int) *s2;
@@ -232,11 +464,18 @@ memcmp(const void *v1, const void *v2, size_t n)
 void *
 memfind(const void *s, int c, size_t n)
 {
-	const void *ends = (const char *) s + n;
-	for (; s < ends; s++)
-		if (*(const unsigned char *) s == (unsigned char) c)
+	const unsigned char *p = s, *ends = p + n;
+	uint32_t pat = (uint8_t) c * ONES;
+
+	for (; p < ends && ((uintptr_t) p & 3); p++)
+		if (*p == (unsigned char) c)
+			return (void *) p;
+	for (; ends - p >= 4 && !haszero(*(const word_t *) p ^ pat); p += 4)
+		/* do nothing */;
+	for (; p < ends; p++)
+		if (*p == (unsigned char) c)
 			break;
-	return (void *) s;
+	return (void *) p;
 }
 
 long
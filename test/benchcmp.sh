@@ -0,0 +1,55 @@
+#!/bin/sh
+# Compare the results of 'make qemu-bench' with a baseline.
+#
+#	usage: test/benchcmp.sh baseline results [tolerance]
+#
+# Both files hold the "@@ result" lines of kernel/benchrun.c without
+# the prefix: "<value> <unit> <name>", where lower values are better.
+# Exits 1 if a baseline result is missing or more than tolerance
+# percent (default 10) higher.
+
+if [ $# -lt 2 ]; then
+	echo "usage: $0 baseline results [tolerance]" >&2
+	exit 2
+fi
+
+awk -v tol="${3:-10}" '
+function name(	s) {
+	s = $0
+	sub(/^[^ ]+ [^ ]+ /, "", s)
+	return s
+}
+FNR == NR {
+	k = name()
+	base[k] = $1
+	unit[k] = $2
+	order[n++] = k
+	next
+}
+{
+	k = name()
+	now[k] = $1
+	if (!(k in base))
+		added[m++] = k
+}
+END {
+	printf "%-36s %-6s %12s %12s %8s\n", "RESULT", "UNIT", "BASELINE", "NOW", "CHANGE"
+	for (i = 0; i < n; i++) {
+		k = order[i]
+		if (!(k in now)) {
+			printf "%-36s %-6s %12s %12s  missing\n", k, unit[k], base[k], "-"
+			bad++
+			continue
+		}
+		pct = base[k] > 0 ? (now[k] - base[k]) * 100 / base[k] : 0
+		printf "%-36s %-6s %12s %12s %+7.1f%%%s\n", k, unit[k], base[k], now[k], pct, \
+			(pct > tol ? "  SLOWER" : "")
+		if (pct > tol)
+			bad++
+	}
+	for (i = 0; i < m; i++)
+		printf "%-36s %-6s %12s %12s  new\n", added[i], "", "-", now[added[i]]
+	if (bad)
+		printf "%d of %d results regressed by more than %s%%\n", bad, n, tol
+	exit bad > 0
+}' "$1" "$2"
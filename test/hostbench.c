@@ -0,0 +1,141 @@
+// Microbenchmarks of lib/ against the host C library, as CSV:
+//
+//	function,size,align,jos_cycles,libc_cycles
+//
+// Each cell is the fewest TSC cycles of several timed runs of one
+// call, after warming the caches and the branch predictors.  align is
+// the offset of the buffers from a 64-byte boundary.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// lib/, renamed by test/Makefile
+void *jos_memcpy(void *dst, const void *src, size_t n);
+void *jos_memset(void *dst, int c, size_t n);
+int jos_strlen(const char *s);
+int jos_vsnprintf(char *buf, int n, const char *fmt, va_list ap);
+void jos_string_init(void);
+
+#define WARMUP	8
+#define TRIALS	32
+#define MAXSIZE	(1 << 20)
+
+static const size_t sizes[] = {
+	1, 3, 8, 15, 16, 31, 64, 100, 256, 1000, 4096, 16384, 65536, 1 << 20,
+};
+static const int aligns[] = { 0, 1, 3 };
+
+static char *srcbuf, *dstbuf;
+
+// Keeps the compiler from dropping calls whose result is unused
+volatile size_t sink;
+
+static inline uint64_t
+rdtsc(void)
+{
+	uint32_t lo, hi;
+
+	__asm __volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) :: "memory");
+	return ((uint64_t) hi << 32) | lo;
+}
+
+// Time one call of stmt: minimum over TRIALS runs after WARMUP
+#define TIME(stmt)							\
+({									\
+	uint64_t __t, __best = ~0ULL;					\
+	int __i;							\
+	for (__i = 0; __i < WARMUP + TRIALS; __i++) {			\
+		__t = rdtsc();						\
+		stmt;							\
+		__t = rdtsc() - __t;					\
+		if (__i >= WARMUP && __t < __best)			\
+			__best = __t;					\
+	}								\
+	__best;								\
+})
+
+static int
+fmt_jos(char *buf, int n, const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+
+	va_start(ap, fmt);
+	r = jos_vsnprintf(buf, n, fmt, ap);
+	va_end(ap);
+	return r;
+}
+
+static int
+fmt_libc(char *buf, int n, const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+
+	va_start(ap, fmt);
+	r = vsnprintf(buf, n, fmt, ap);
+	va_end(ap);
+	return r;
+}
+
+#define FMTROW(name, fmt, ...)						\
+	row(name, fmt_jos(dstbuf, 256, fmt, __VA_ARGS__), 0,		\
+	    TIME(fmt_jos(dstbuf, 256, fmt, __VA_ARGS__)),		\
+	    TIME(fmt_libc(dstbuf, 256, fmt, __VA_ARGS__)))
+
+static void
+row(const char *func, size_t size, int align, uint64_t jos, uint64_t libc)
+{
+	printf("%s,%u,%d,%llu,%llu\n", func, (unsigned) size, align,
+	       (unsigned long long) jos, (unsigned long long) libc);
+}
+
+int
+main(void)
+{
+	char *src, *dst;
+	size_t n;
+	int s, a;
+
+	jos_string_init();
+	srcbuf = aligned_alloc(64, MAXSIZE + 128);
+	dstbuf = aligned_alloc(64, MAXSIZE + 128);
+	if (!srcbuf || !dstbuf) {
+		perror("aligned_alloc");
+		return 1;
+	}
+	memset(srcbuf, 'a', MAXSIZE + 128);
+	memset(dstbuf, 'b', MAXSIZE + 128);
+
+	printf("function,size,align,jos_cycles,libc_cycles\n");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+		for (a = 0; a < sizeof(aligns) / sizeof(aligns[0]); a++) {
+			n = sizes[s];
+			src = srcbuf + aligns[a];
+			dst = dstbuf + aligns[a];
+			row("memcpy", n, aligns[a],
+			    TIME(jos_memcpy(dst, src, n)),
+			    TIME(memcpy(dst, src, n)));
+			row("memset", n, aligns[a],
+			    TIME(jos_memset(dst, 0, n)),
+			    TIME(memset(dst, 0, n)));
+
+			src[n - 1] = '\0';
+			row("strlen", n, aligns[a],
+			    TIME(sink = jos_strlen(src)),
+			    TIME(sink = strlen(src)));
+			src[n - 1] = 'a';
+		}
+
+	// vsnprintf: size is the length of the output, align is unused
+	FMTROW("vsnprintf_u", "%u", 4000000000u);
+	FMTROW("vsnprintf_08x", "%08x", 0xbeefu);
+	FMTROW("vsnprintf_llu", "%llu", 18446744073709551557ULL);
+	FMTROW("vsnprintf_s", "%s", "the quick brown fox jumps");
+	FMTROW("vsnprintf_mixed", "cpu %d: %u ticks, %s\n", 3, 4000000000u,
+	       "idle");
+	return 0;
+}
@@ -0,0 +1,140 @@
+// Tests of lib/printfmt.c: numbers and strings against the C library's
+// snprintf, and the formats where JOS differs against fixed strings.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+// lib/printfmt.c, renamed by test/Makefile
+int jos_snprintf(char *str, int size, const char *fmt, ...);
+
+static uint64_t
+rand64(void)
+{
+	uint64_t v = ((uint64_t) rand() << 62) ^ ((uint64_t) rand() << 31) ^ rand();
+
+	// Every bit length, so every digit count shows up
+	return v >> (rand() % 64);
+}
+
+// Formats whose output matches the C library's, one argument each
+static void
+test_numbers(void)
+{
+	static const char * const fmt32[] = {
+		"%d", "%u", "%x", "%ld", "%lu", "%lx", "%08x", "%5u",
+		"%12d", "%0d", "[%3x]", "%p",
+	};
+	static const char * const fmt64[] = {
+		"%lld", "%llu", "%llx", "%020llu", "%016llx", "%25lld",
+	};
+	char got[128], want[128];
+	uint64_t v;
+	int i, j, r1, r2;
+
+	for (i = 0; i < 200000; i++) {
+		v = rand64();
+		for (j = 0; j < sizeof(fmt32) / sizeof(fmt32[0]); j++) {
+			// Keep %d non-negative: JOS pads after the sign
+			uint32_t w = (j == 0 || j == 3 || j == 8 || j == 9) ?
+				(uint32_t) v & 0x7fffffff : (uint32_t) v;
+
+			if (j == 11 && w == 0)
+				continue;	// %p of NULL is "(nil)" in glibc
+			r1 = jos_snprintf(got, sizeof(got), fmt32[j], w);
+			r2 = snprintf(want, sizeof(want), fmt32[j], w);
+			CHECK(r1 == r2 && strcmp(got, want) == 0,
+			      "'%s' of %u: '%s' != '%s'", fmt32[j], w, got, want);
+		}
+		for (j = 0; j < sizeof(fmt64) / sizeof(fmt64[0]); j++) {
+			if (j == 0 || j == 5)
+				v &= ~(1ULL << 63);
+			r1 = jos_snprintf(got, sizeof(got), fmt64[j], v);
+			r2 = snprintf(want, sizeof(want), fmt64[j], v);
+			CHECK(r1 == r2 && strcmp(got, want) == 0,
+			      "'%s': '%s' != '%s'", fmt64[j], got, want);
+		}
+	}
+}
+
+static void
+test_strings(void)
+{
+	static const char * const fmts[] = {
+		"%s", "%10s", "%.3s", "%8.3s", "<%s|%s>", "%c%c%c",
+		"100%% literal text", "", "%s%s%s%s%s",
+	};
+	static const char * const args[] = {
+		"", "a", "hello", "a longer string than any width",
+	};
+	char got[256], want[256];
+	int i, a, r1, r2;
+
+	for (i = 0; i < sizeof(fmts) / sizeof(fmts[0]); i++)
+		for (a = 0; a < sizeof(args) / sizeof(args[0]); a++) {
+			if (strstr(fmts[i], "%c")) {
+				r1 = jos_snprintf(got, sizeof(got), fmts[i], 'x', 'y', 'z');
+				r2 = snprintf(want, sizeof(want), fmts[i], 'x', 'y', 'z');
+			} else {
+				r1 = jos_snprintf(got, sizeof(got), fmts[i], args[a],
+						  args[a], args[a], args[a], args[a]);
+				r2 = snprintf(want, sizeof(want), fmts[i], args[a],
+					      args[a], args[a], args[a], args[a]);
+			}
+			CHECK(r1 == r2 && strcmp(got, want) == 0,
+			      "'%s': '%s' != '%s'", fmts[i], got, want);
+		}
+}
+
+// Where JOS deliberately or historically differs from C
+static void
+test_jos_formats(void)
+{
+	char buf[64];
+
+	jos_snprintf(buf, sizeof(buf), "%e|%e|%e", -4, 4, 99);
+	CHECK(strcmp(buf, "out of memory|out of memory|error 99") == 0,
+	      "%%e: '%s'", buf);
+	jos_snprintf(buf, sizeof(buf), "%5d|%05d", -42, -42);
+	CHECK(strcmp(buf, "-   42|-00042") == 0, "negative width: '%s'", buf);
+	jos_snprintf(buf, sizeof(buf), "%-5d|%-6s|", 42, "ab");
+	CHECK(strcmp(buf, "---42|ab    |") == 0, "'-' flag: '%s'", buf);
+	jos_snprintf(buf, sizeof(buf), "%#s", "a\tb\x7f");
+	CHECK(strcmp(buf, "a?b?") == 0, "%%#s: '%s'", buf);
+	jos_snprintf(buf, sizeof(buf), "%s", NULL);
+	CHECK(strcmp(buf, "(null)") == 0, "%%s of NULL: '%s'", buf);
+	jos_snprintf(buf, sizeof(buf), "%y%d", 5);
+	CHECK(strcmp(buf, "%y5") == 0, "unknown verb: '%s'", buf);
+}
+
+static void
+test_truncation(void)
+{
+	char buf[16];
+	int size, r;
+
+	for (size = 1; size <= sizeof(buf); size++) {
+		memset(buf, 'Q', sizeof(buf));
+		r = jos_snprintf(buf, size, "%s-%u", "abcdef", 1234567);
+		CHECK(r == 14, "return value %d with size %d", r, size);
+		CHECK(buf[(size < 15 ? size : 15) - 1] == '\0' &&
+		      strncmp(buf, "abcdef-1234567", size - 1) == 0 &&
+		      (size == sizeof(buf) || buf[size] == 'Q'),
+		      "truncated to %d: '%.16s'", size, buf);
+	}
+	CHECK(jos_snprintf(buf, 0, "x") < 0, "size 0 is an error");
+}
+
+int
+main(void)
+{
+	srand(1);
+	test_numbers();
+	test_strings();
+	test_jos_formats();
+	test_truncation();
+	return test_done("printfmt_test");
+}
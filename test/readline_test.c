@@ -0,0 +1,113 @@
+// Tests of lib/readline.c, fed scripted keystrokes.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+
+// lib/readline.c and lib/printfmt.c, renamed by test/Makefile
+char *jos_readline(const char *prompt);
+void jos_vprintfmt(void (*putch)(int, void *), void *putdat,
+		   const char *fmt, va_list ap);
+
+// The console, as seen by readline
+static const char *input;	// Keystrokes still to deliver
+static char output[4096];	// Everything echoed
+static int outlen;
+
+int
+jos_getc(void)
+{
+	if (*input == '\0')
+		return -1;
+	return (unsigned char) *input++;
+}
+
+void
+jos_putch(int c)
+{
+	if (outlen < sizeof(output) - 1)
+		output[outlen++] = c;
+	output[outlen] = '\0';
+}
+
+static void
+cprintf_putch(int c, void *cnt)
+{
+	jos_putch(c);
+	(*(int *) cnt)++;
+}
+
+// Formats like the kernel's, which has its own %e
+int
+jos_cprintf(const char *fmt, ...)
+{
+	va_list ap;
+	int n = 0;
+
+	va_start(ap, fmt);
+	jos_vprintfmt(cprintf_putch, &n, fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+static char *
+run(const char *prompt, const char *keys)
+{
+	input = keys;
+	outlen = 0;
+	output[0] = '\0';
+	return jos_readline(prompt);
+}
+
+static void
+expect(const char *prompt, const char *keys, const char *line,
+       const char *echo)
+{
+	char *got = run(prompt, keys);
+
+	CHECK(got && strcmp(got, line) == 0, "line of '%s': '%s', want '%s'",
+	      keys, got ? got : "(null)", line);
+	CHECK(strcmp(output, echo) == 0, "echo of '%s': '%s', want '%s'",
+	      keys, output, echo);
+}
+
+int
+main(void)
+{
+	static char keys[2048], want[1024];
+	char *got;
+
+	expect(NULL, "hello\n", "hello", "hello\n");
+	expect("K> ", "ls\r", "ls", "K> ls\n");
+	expect(NULL, "\n", "", "\n");
+	expect(NULL, "ab\bc\n", "ac", "ab\bc\n");
+	expect(NULL, "ab\x7f\x7fz\n", "z", "ab\b\bz\n");
+	expect(NULL, "\ba\tb\x01\n", "ab", "ab\n");
+	expect(NULL, "one\ntwo\n", "one", "one\n");
+
+	// The line holds at most 1023 characters; the rest are dropped
+	memset(keys, 'x', 1500);
+	strcpy(keys + 1500, "\n");
+	memset(want, 'x', 1023);
+	want[1023] = '\0';
+	got = run(NULL, keys);
+	CHECK(got && strcmp(got, want) == 0, "long line: %d characters",
+	      got ? (int) strlen(got) : -1);
+	CHECK(outlen == 1024, "long line echoed %d characters", outlen);
+
+	// A backspace at the limit makes room again
+	strcpy(keys + 1500, "\bab\n");
+	got = run(NULL, keys);
+	CHECK(got && strlen(got) == 1023 && strcmp(got + 1021, "xa") == 0,
+	      "backspace at the limit");
+
+	// End of input is a read error
+	got = run(NULL, "abc");
+	CHECK(got == NULL, "read error returned a line");
+	CHECK(strcmp(output, "abcread error: unspecified error\n") == 0,
+	      "read error echo: '%s'", output);
+
+	return test_done("readline_test");
+}
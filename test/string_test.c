@@ -0,0 +1,266 @@
+// Differential tests of lib/string.c against the plain byte loops it
+// replaced.  Strings are placed so that they end at a page followed by
+// an inaccessible guard page, so reading past a terminator faults.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "test.h"
+
+// lib/string.c, renamed by test/Makefile
+int jos_strlen(const char *s);
+char *jos_strchr(const char *s, char c);
+int jos_strcmp(const char *p, const char *q);
+int jos_memcmp(const void *v1, const void *v2, size_t n);
+void *jos_memfind(const void *s, int c, size_t n);
+void *jos_memset(void *v, int c, size_t n);
+void *jos_memmove(void *dst, const void *src, size_t n);
+
+#define PGSIZE	4096
+
+/***** Reference byte loops *****/
+
+static int
+ref_strlen(const char *s)
+{
+	int n;
+
+	for (n = 0; *s != '\0'; s++)
+		n++;
+	return n;
+}
+
+static char *
+ref_strchr(const char *s, char c)
+{
+	for (; *s; s++)
+		if (*s == c)
+			return (char *) s;
+	return 0;
+}
+
+static int
+ref_strcmp(const char *p, const char *q)
+{
+	while (*p && *p == *q)
+		p++, q++;
+	return (int) ((unsigned char) *p - (unsigned char) *q);
+}
+
+static int
+ref_memcmp(const void *v1, const void *v2, size_t n)
+{
+	const uint8_t *s1 = v1, *s2 = v2;
+
+	while (n-- > 0) {
+		if (*s1 != *s2)
+			return (int) *s1 - (int) *s2;
+		s1++, s2++;
+	}
+	return 0;
+}
+
+static void *
+ref_memfind(const void *s, int c, size_t n)
+{
+	const unsigned char *p = s, *ends = p + n;
+
+	for (; p < ends; p++)
+		if (*p == (unsigned char) c)
+			break;
+	return (void *) p;
+}
+
+/***** Test buffers *****/
+
+// Two pages of data, each followed by a guard page
+static char *bufa, *bufb;
+
+static char *
+guarded_alloc(void)
+{
+	char *p = mmap(NULL, 2 * PGSIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED || mprotect(p + PGSIZE, PGSIZE, PROT_NONE) < 0) {
+		perror("mmap");
+		exit(2);
+	}
+	return p;
+}
+
+// Random non-zero bytes, including ones with the top bit set
+static void
+fill_random(char *p, int n)
+{
+	while (n-- > 0)
+		*p++ = (rand() % 255) + 1;
+}
+
+// A random string of length len whose terminator is the last byte
+// before the guard page, so its start has every possible alignment.
+static char *
+string_at_end(char *buf, int len)
+{
+	char *s = buf + PGSIZE - 1 - len;
+
+	fill_random(s, len);
+	s[len] = '\0';
+	return s;
+}
+
+static void
+test_strlen(void)
+{
+	int len, off;
+	char *s;
+
+	for (len = 0; len < 300; len++) {
+		s = string_at_end(bufa, len);
+		CHECK(jos_strlen(s) == len, "strlen at end, len %d", len);
+		for (off = 0; off < 8; off++) {
+			s = bufa + off;
+			fill_random(s, len);
+			s[len] = '\0';
+			CHECK(jos_strlen(s) == ref_strlen(s),
+			      "strlen len %d off %d", len, off);
+		}
+	}
+}
+
+static void
+test_strchr(void)
+{
+	int len, i, c;
+	char *s;
+
+	for (len = 0; len < 200; len++) {
+		s = string_at_end(bufa, len);
+		for (i = 0; i < 20; i++) {
+			// Mostly characters in the string, some not,
+			// and the terminator itself
+			if (i == 0)
+				c = 0;
+			else if (len && i < 15)
+				c = s[rand() % len];
+			else
+				c = rand() % 256;
+			CHECK(jos_strchr(s, c) == ref_strchr(s, c),
+			      "strchr len %d c 0x%02x", len, c & 0xff);
+		}
+	}
+	CHECK(jos_strchr("\t\r\n ", ' ') == ref_strchr("\t\r\n ", ' ') &&
+	      jos_strchr("\t\r\n ", 'x') == NULL, "strchr WHITESPACE");
+}
+
+static void
+test_strcmp(void)
+{
+	int len, offa, diff, r, e;
+	char *p, *q;
+
+	for (len = 0; len < 100; len++)
+		for (offa = 0; offa < 4; offa++)
+			for (diff = -1; diff <= len; diff++) {
+				// p ends at a guard page, q is a copy
+				// with any alignment relative to p
+				p = string_at_end(bufa, len);
+				q = bufb + PGSIZE - 1 - len - offa;
+				memcpy(q, p, len + 1);
+				if (diff >= 0)
+					q[diff] = (diff == len) ?
+						(rand() % 255) + 1 :
+						q[diff] ^ (1 + rand() % 255);
+				r = jos_strcmp(p, q);
+				e = ref_strcmp(p, q);
+				CHECK(r == e, "strcmp len %d off %d diff %d: %d != %d",
+				      len, offa, diff, r, e);
+				r = jos_strcmp(q, p);
+				e = ref_strcmp(q, p);
+				CHECK(r == e, "strcmp (swapped) len %d off %d diff %d",
+				      len, offa, diff);
+			}
+}
+
+static void
+test_memcmp(void)
+{
+	int n, offa, offb, diff;
+	char *p, *q;
+
+	for (n = 0; n < 80; n++)
+		for (offa = 0; offa < 4; offa++)
+			for (offb = 0; offb < 4; offb++)
+				for (diff = -1; diff < n; diff++) {
+					p = bufa + PGSIZE - n - offa;
+					q = bufb + PGSIZE - n - offb;
+					fill_random(p, n);
+					memcpy(q, p, n);
+					if (diff >= 0)
+						q[diff] ^= 1 + rand() % 255;
+					CHECK(jos_memcmp(p, q, n) == ref_memcmp(p, q, n),
+					      "memcmp n %d offs %d/%d diff %d",
+					      n, offa, offb, diff);
+				}
+}
+
+static void
+test_memfind(void)
+{
+	int n, off, i, c;
+	char *p;
+
+	for (n = 0; n < 200; n++)
+		for (off = 0; off < 4; off++) {
+			p = bufa + PGSIZE - n - off;
+			fill_random(p, n + off);
+			for (i = 0; i < 10; i++) {
+				c = (n && i < 6) ? p[rand() % n] : rand() % 256;
+				CHECK(jos_memfind(p, c, n) == ref_memfind(p, c, n),
+				      "memfind n %d off %d c 0x%02x", n, off, c & 0xff);
+			}
+		}
+}
+
+static void
+test_memmove_memset(void)
+{
+	static char a[8192], b[8192];
+	int n, src, dst, i;
+
+	for (i = 0; i < 20000; i++) {
+		n = rand() % 3000;
+		src = rand() % 4000;
+		dst = rand() % 4000;
+		fill_random(a, sizeof(a));
+		memcpy(b, a, sizeof(a));
+		jos_memmove(a + dst, a + src, n);
+		memmove(b + dst, b + src, n);
+		CHECK(memcmp(a, b, sizeof(a)) == 0, "memmove n %d src %d dst %d",
+		      n, src, dst);
+
+		jos_memset(a + dst, src, n);
+		memset(b + dst, src, n);
+		CHECK(memcmp(a, b, sizeof(a)) == 0, "memset n %d dst %d", n, dst);
+	}
+}
+
+int
+main(void)
+{
+	srand(1);
+	bufa = guarded_alloc();
+	bufb = guarded_alloc();
+
+	test_strlen();
+	test_strchr();
+	test_strcmp();
+	test_memcmp();
+	test_memfind();
+	test_memmove_memset();
+
+	return test_done("string_test");
+}
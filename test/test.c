@@ -0,0 +1,13 @@
+// Shared helpers for the host-side tests of lib/.
+
+#include "test.h"
+
+int failures;
+
+int
+test_done(const char *name)
+{
+	printf("%s: %s (%d failures)\n", name, failures ? "FAIL" : "ok",
+	       failures);
+	return failures != 0;
+}
@@ -0,0 +1,25 @@
+// Shared helpers for the host-side tests of lib/.
+
+#ifndef JOS_TEST_TEST_H
+#define JOS_TEST_TEST_H
+
+#include <stdio.h>
+
+extern int failures;
+
+// Report a failed check (the first few, to keep the output short)
+#define CHECK(cond, ...)						\
+do {									\
+	if (!(cond)) {							\
+		if (failures++ < 20) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+// Print the summary line; returns the exit status for main()
+int test_done(const char *name);
+
+#endif	// !JOS_TEST_TEST_H